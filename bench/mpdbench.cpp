@@ -0,0 +1,94 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QCoreApplication>
+#include "mpdownloader.h"
+
+/**
+ * @brief Default number of parts for every benchmarked download.
+ */
+#define BENCH_DEFAULT_PARTS 16
+
+/**
+ * @brief Default number of downloads per transport.
+ */
+#define BENCH_DEFAULT_RUNS 3
+
+/**
+ * @brief Downloads the same resource with every transport and reports the throughput.
+ *
+ * Usage: mpdbench URL [parts] [runs]
+ */
+int main(int argc,char *argv[]) {
+    QCoreApplication appMain(argc,argv);
+    QStringList      slArgs=appMain.arguments();
+    QTextStream      txsOut(stdout);
+    QTemporaryDir    tmdTarget;
+    QString          sURL,sTargetFile;
+    int              iParts=BENCH_DEFAULT_PARTS,
+                     iRuns=BENCH_DEFAULT_RUNS;
+    const QList<QPair<MPDTransport,QString>> lstTransports={
+        {MPDTransport::MPDT_HTTP1,QStringLiteral("HTTP/1.1")},
+        {MPDTransport::MPDT_HTTP2,QStringLiteral("HTTP/2")}
+    };
+    if(2>slArgs.count()) {
+        txsOut << "Usage: mpdbench URL [parts] [runs]" << Qt::endl;
+        return 1;
+    }
+    sURL=slArgs.at(1);
+    if(2<slArgs.count())
+        iParts=qMax(1,slArgs.at(2).toInt());
+    if(3<slArgs.count())
+        iRuns=qMax(1,slArgs.at(3).toInt());
+    if(!tmdTarget.isValid()) {
+        txsOut << "Unable to create a temporary folder" << Qt::endl;
+        return 1;
+    }
+    sTargetFile=tmdTarget.filePath(QStringLiteral("mpdbench.tmp"));
+    txsOut << "Parts: " << iParts << ", runs: " << iRuns << Qt::endl;
+    for(const auto &t:lstTransports) {
+        MPDownloader mpdBench;
+        mpdBench.setMaxParts(iParts);
+        // Every run must use the very same number of parts.
+        mpdBench.setAutoTune(false);
+        mpdBench.setTransport(t.first);
+        for(int iK=0;iK<iRuns;iK++) {
+            QElapsedTimer etmRun;
+            qint64        i64Elapsed,i64Size;
+            // Starts from scratch every time, so nothing gets resumed.
+            QFile::remove(sTargetFile);
+            etmRun.start();
+            if(!mpdBench.download(sURL,sTargetFile)) {
+                txsOut << t.second << " #" << iK+1 << ": failed - "
+                       << mpdBench.getLastError() << Qt::endl;
+                continue;
+            }
+            i64Elapsed=qMax<qint64>(1,etmRun.elapsed());
+            i64Size=QFileInfo(sTargetFile).size();
+            txsOut << t.second << " #" << iK+1 << ": "
+                   << i64Size << " bytes in " << i64Elapsed << " ms ("
+                   << QString::number(i64Size/1048576.0/(i64Elapsed/1000.0),'f',2)
+                   << " MiB/s)" << Qt::endl;
+        }
+        MPDPoolStats mpsStats=mpdBench.getPoolStats();
+        txsOut << t.second << " pool: " << mpsStats.ui64Hits << " hits, "
+               << mpsStats.ui64Misses << " misses, "
+               << mpsStats.ui64PeakInFlight << " bytes in flight (peak)" << Qt::endl;
+    }
+    return 0;
+}
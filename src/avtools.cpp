@@ -18,8 +18,14 @@
 
 #include "avtools.h"
 
+/**
+ * @brief Size of the buffer used to read the callback sources.
+ */
+#define AVT_IO_BUFFER_SIZE 65536
+
 AVTools::AVTools() {
     sLastError.clear();
+    aiInterrupted.storeRelaxed(0);
 }
 
 /**
@@ -31,6 +37,16 @@ QString AVTools::getLastError() {
     return sLastError;
 }
 
+/**
+ * @brief Stops the muxing in progress (if any), which fails as soon as possible.
+ *
+ * Safe to be called from any thread. The object stays interrupted, so any muxing
+ * started later fails right away too.
+ */
+void AVTools::interrupt() {
+    aiInterrupted.storeRelease(1);
+}
+
 /**
  * @brief Saves a copy of the input video.
  *
@@ -205,10 +221,47 @@ bool AVTools::saveAs(QString sIn,QString sOut,float fStartTime,float fEndTime) {
  * @return true if no errors ocurred during the video processing
  */
 bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
+    return this->muxStreams(sVideoIn,NULL,sAudioIn,NULL,sOut);
+}
+
+/**
+ * @brief Combines the input video and audio streams into a single video, reading them
+ * through callbacks.
+ *
+ * The sources are read as the muxing goes, so they can still be arriving (e.g. from
+ * a download in progress): the muxing starts as soon as their headers are available.
+ * The sources are never seeked, so their headers must come first.
+ *
+ * @param[in] avsVideoIn  input video stream source
+ * @param[in] avsAudioIn  input audio stream source
+ * @param[in] sOut        output video path
+ *
+ * @return true if no errors ocurred during the video processing
+ */
+bool AVTools::saveAs(AVSource avsVideoIn,AVSource avsAudioIn,QString sOut) {
+    return this->muxStreams(QString(),&avsVideoIn,QString(),&avsAudioIn,sOut);
+}
+
+/**
+ * @brief Combines the input video and audio streams into a single video.
+ *
+ * Every input is either a file path or, when its source is not NULL, a callback source.
+ *
+ * @param[in] sVideoIn    input video stream path
+ * @param[in] avsVideoIn  input video stream source (or NULL)
+ * @param[in] sAudioIn    input audio stream path
+ * @param[in] avsAudioIn  input audio stream source (or NULL)
+ * @param[in] sOut        output video path
+ *
+ * @return true if no errors ocurred during the video processing
+ */
+bool AVTools::muxStreams(QString sVideoIn,AVSource *avsVideoIn,QString sAudioIn,AVSource *avsAudioIn,QString sOut) {
     bool            bResult=false,
                     bVideoInEOF=false,
                     bAudioInEOF=false;
     int             iError=0;
+    int64_t         i64VideoDTS=AV_NOPTS_VALUE,
+                    i64AudioDTS=AV_NOPTS_VALUE;
     char            szError[AV_ERROR_MAX_STRING_SIZE];
     AVFormatContext *fcVideoIn=NULL,
                     *fcAudioIn=NULL,
@@ -219,13 +272,16 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
                     *stAudioOut=NULL;
     AVPacket        *pkVideoIn=NULL,
                     *pkAudioIn=NULL;
+    AVIOContext     *ioVideoIn=NULL,
+                    *ioAudioIn=NULL;
     sLastError.clear();
     try {
         // Finds the first video stream in the first (source) supplied container.
         fcVideoIn=avformat_alloc_context();
         if(NULL==fcVideoIn)
             throw std::exception("avformat_alloc_context(video in) failed");
-        iError=avformat_open_input(&fcVideoIn,sVideoIn.toUtf8().data(),NULL,NULL);
+        fcVideoIn->interrupt_callback={checkInterrupt,this};
+        iError=openInput(&fcVideoIn,&ioVideoIn,sVideoIn,avsVideoIn);
         if(0>iError)
             throw std::exception("avformat_alloc_output_context2(video in) failed");
         iError=avformat_find_stream_info(fcVideoIn,NULL);
@@ -242,7 +298,8 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
         fcAudioIn=avformat_alloc_context();
         if(NULL==fcAudioIn)
             throw std::exception("avformat_alloc_context(audio in) failed");
-        iError=avformat_open_input(&fcAudioIn,sAudioIn.toUtf8().data(),NULL,NULL);
+        fcAudioIn->interrupt_callback={checkInterrupt,this};
+        iError=openInput(&fcAudioIn,&ioAudioIn,sAudioIn,avsAudioIn);
         if(0>iError)
             throw std::exception("avformat_alloc_output_context2(audio in) failed");
         iError=avformat_find_stream_info(fcAudioIn,NULL);
@@ -260,6 +317,7 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
         iError=avformat_alloc_output_context2(&fcOut,NULL,NULL,sOut.toUtf8().data());
         if(0>iError)
             throw std::exception("avformat_alloc_output_context2(out) failed");
+        fcOut->interrupt_callback={checkInterrupt,this};
         stVideoOut=avformat_new_stream(fcOut,NULL);
         if(NULL==stVideoOut)
             throw std::exception("avformat_new_stream(video out) failed");
@@ -275,16 +333,36 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
             throw std::exception("avcodec_parameters_copy(audio out,audio in) failed");
         stAudioOut->codecpar->codec_tag=0;
         if(!(fcOut->flags&AVFMT_NOFILE)) {
-            iError=avio_open(&fcOut->pb,sOut.toUtf8().data(),AVIO_FLAG_WRITE);
+            iError=avio_open2(&fcOut->pb,sOut.toUtf8().data(),AVIO_FLAG_WRITE,&fcOut->interrupt_callback,NULL);
             if(0>iError)
-                throw std::exception("avio_open(out) failed");
+                throw std::exception("avio_open2(out) failed");
         }
-        // Copies the source packets (video/audio, alternately) into the target container.
+        // Copies the source packets into the target container, always from the input ...
+        // ... which is behind (lowest DTS), so the interleaving queue stays short ...
+        // ... and a source being downloaded is never read far ahead of the other.
         iError=avformat_write_header(fcOut,NULL);
         if(0>iError)
             throw std::exception("avformat_write_header(out) failed");
         while(!bVideoInEOF||!bAudioInEOF) {
-            if(!bVideoInEOF) {
+            bool bVideoNext;
+            // Reads from callback sources (or already buffered) are not checked by FFmpeg itself.
+            if(aiInterrupted.loadAcquire()) {
+                iError=AVERROR_EXIT;
+                throw std::exception("Muxing interrupted");
+            }
+            if(bVideoInEOF||bAudioInEOF)
+                bVideoNext=!bVideoInEOF;
+            // An input without any timestamp yet is read first.
+            else if(AV_NOPTS_VALUE==i64VideoDTS||AV_NOPTS_VALUE==i64AudioDTS)
+                bVideoNext=AV_NOPTS_VALUE==i64VideoDTS;
+            else
+                bVideoNext=0>=av_compare_ts(
+                    i64VideoDTS,
+                    stVideoOut->time_base,
+                    i64AudioDTS,
+                    stAudioOut->time_base
+                );
+            if(bVideoNext) {
                 pkVideoIn=av_packet_alloc();
                 if(NULL==pkVideoIn)
                     throw std::exception("av_packet_alloc(video in) failed");
@@ -296,6 +374,8 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
                         throw std::exception("av_read_frame(video in) failed");
                 else {
                     av_packet_rescale_ts(pkVideoIn,stVideoIn->time_base,stVideoOut->time_base);
+                    if(AV_NOPTS_VALUE!=pkVideoIn->dts)
+                        i64VideoDTS=pkVideoIn->dts;
                     pkVideoIn->pos=-1;
                     pkVideoIn->stream_index=stVideoOut->index;
                     iError=av_interleaved_write_frame(fcOut,pkVideoIn);
@@ -304,7 +384,7 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
                 }
                 av_packet_free(&pkVideoIn);
             }
-            if(!bAudioInEOF) {
+            else {
                 pkAudioIn=av_packet_alloc();
                 if(NULL==pkAudioIn)
                     throw std::exception("av_packet_alloc(audio in) failed");
@@ -316,6 +396,8 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
                         throw std::exception("av_read_frame(audio in) failed");
                 else {
                     av_packet_rescale_ts(pkAudioIn,stAudioIn->time_base,stAudioOut->time_base);
+                    if(AV_NOPTS_VALUE!=pkAudioIn->dts)
+                        i64AudioDTS=pkAudioIn->dts;
                     pkAudioIn->pos=-1;
                     pkAudioIn->stream_index=stAudioOut->index;
                     iError=av_interleaved_write_frame(fcOut,pkAudioIn);
@@ -341,6 +423,12 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
         avformat_close_input(&fcVideoIn);
     if(NULL!=fcAudioIn)
         avformat_close_input(&fcAudioIn);
+    // Custom I/O contexts are not released along with their format contexts.
+    for(auto ioIn:{&ioVideoIn,&ioAudioIn})
+        if(NULL!=*ioIn) {
+            av_freep(&(*ioIn)->buffer);
+            avio_context_free(ioIn);
+        }
     if(NULL!=fcOut) {
         if(!(fcOut->flags&AVFMT_NOFILE))
             avio_closep(&fcOut->pb);
@@ -353,3 +441,139 @@ bool AVTools::saveAs(QString sVideoIn,QString sAudioIn,QString sOut) {
         av_packet_free(&pkAudioIn);
     return bResult;
 }
+
+/**
+ * @brief Callback function telling FFmpeg whether a blocking operation must be aborted.
+ *
+ * @param[in] lpcbData  raw pointer to the AVTools object
+ *
+ * @return non-zero once interrupt() has been called
+ */
+int AVTools::checkInterrupt(void *lpcbData) {
+    return reinterpret_cast<AVTools *>(lpcbData)->aiInterrupted.loadAcquire();
+}
+
+/**
+ * @brief Opens an input container, either from a file or from a callback source.
+ *
+ * @param[in,out] fcIn   allocated format context (freed on failure)
+ * @param[out]    ioIn   custom I/O context created for the source (if any)
+ * @param[in]     sIn    input path (ignored when there's a source)
+ * @param[in]     avsIn  input source (or NULL)
+ *
+ * @return 0 on success, or a negative FFmpeg error code
+ */
+int AVTools::openInput(AVFormatContext **fcIn,AVIOContext **ioIn,QString sIn,AVSource *avsIn) {
+    uchar *lpBuffer;
+    if(NULL==avsIn)
+        return avformat_open_input(fcIn,sIn.toUtf8().data(),NULL,NULL);
+    lpBuffer=(uchar *)av_malloc(AVT_IO_BUFFER_SIZE);
+    if(NULL==lpBuffer)
+        return AVERROR(ENOMEM);
+    *ioIn=avio_alloc_context(lpBuffer,AVT_IO_BUFFER_SIZE,0,avsIn,readSource,NULL,NULL);
+    if(NULL==*ioIn) {
+        av_free(lpBuffer);
+        return AVERROR(ENOMEM);
+    }
+    // The demuxers must not try to seek, since the sources can only be read forward.
+    (*ioIn)->seekable=0;
+    (*fcIn)->pb=*ioIn;
+    (*fcIn)->flags|=AVFMT_FLAG_CUSTOM_IO;
+    return avformat_open_input(fcIn,NULL,NULL,NULL);
+}
+
+/**
+ * @brief Reads the next bytes of a callback source, on behalf of its I/O context.
+ *
+ * @param[in]  lpOpaque  the source
+ * @param[out] lpBuffer  buffer receiving the bytes
+ * @param[in]  iSize     maximum amount of bytes to read
+ *
+ * @return the amount of bytes read, AVERROR_EOF at the end, or AVERROR(EIO) on errors
+ */
+int AVTools::readSource(void *lpOpaque,uint8_t *lpBuffer,int iSize) {
+    AVSource *avsSource=reinterpret_cast<AVSource *>(lpOpaque);
+    int      iRead=avsSource->arcbRead(lpBuffer,iSize,avsSource->lpcbData);
+    if(0>iRead)
+        return AVERROR(EIO);
+    if(0==iRead)
+        return AVERROR_EOF;
+    return iRead;
+}
+
+/**
+ * @brief Reads every packet of the input media, without decoding anything.
+ *
+ * It's a fast way of checking the whole file can be demuxed (e.g. right after
+ * downloading it, and before muxing it), and of getting its actual duration.
+ *
+ * @param[in]  sIn          input media path
+ * @param[out] ui64Packets  number of packets found
+ * @param[out] fDuration    duration of the longest stream, in seconds
+ *
+ * @return true if every packet could be read
+ */
+bool AVTools::scan(QString sIn,quint64 &ui64Packets,float &fDuration) {
+    bool            bResult=false;
+    int             iError=0;
+    char            szError[AV_ERROR_MAX_STRING_SIZE];
+    int64_t         i64Time,i64Start;
+    AVFormatContext *fcIn=NULL;
+    AVStream        *stIn=NULL;
+    AVPacket        *pkIn=NULL;
+    sLastError.clear();
+    ui64Packets=0;
+    fDuration=0;
+    try {
+        fcIn=avformat_alloc_context();
+        if(NULL==fcIn)
+            throw std::exception("avformat_alloc_context(in) failed");
+        iError=avformat_open_input(&fcIn,sIn.toUtf8().data(),NULL,NULL);
+        if(0>iError)
+            throw std::exception("avformat_open_input(in) failed");
+        iError=avformat_find_stream_info(fcIn,NULL);
+        if(0>iError)
+            throw std::exception("avformat_find_stream_info(in) failed");
+        pkIn=av_packet_alloc();
+        if(NULL==pkIn)
+            throw std::exception("av_packet_alloc(in) failed");
+        while(true) {
+            iError=av_read_frame(fcIn,pkIn);
+            if(0>iError) {
+                if(AVERROR_EOF==iError) {
+                    iError=0;
+                    break;
+                }
+                else
+                    throw std::exception("av_read_frame(in) failed");
+            }
+            stIn=fcIn->streams[pkIn->stream_index];
+            // The stream duration is where its last packet ends.
+            i64Time=AV_NOPTS_VALUE!=pkIn->pts?pkIn->pts:pkIn->dts;
+            if(AV_NOPTS_VALUE!=i64Time) {
+                i64Start=AV_NOPTS_VALUE!=stIn->start_time?stIn->start_time:0;
+                fDuration=qMax(
+                    fDuration,
+                    (float)(av_q2d(stIn->time_base)*(i64Time-i64Start+pkIn->duration))
+                );
+            }
+            ui64Packets++;
+            av_packet_unref(pkIn);
+        }
+        if(!ui64Packets)
+            throw std::exception("no packets found");
+        bResult=true;
+    }
+    catch(const std::exception &exE) {
+        sLastError=QStringLiteral("%1").arg(exE.what());
+        if(0>iError) {
+            av_strerror(iError,szError,sizeof(szError));
+            sLastError.append(QStringLiteral(" %1").arg(szError));
+        }
+    }
+    if(NULL!=fcIn)
+        avformat_close_input(&fcIn);
+    if(NULL!=pkIn)
+        av_packet_free(&pkIn);
+    return bResult;
+}
@@ -26,23 +26,51 @@ extern "C" {
 #include <libavutil/timestamp.h>
 }
 
+/**
+ * @brief The AVReadCB typedef.
+ *
+ * Declares a callback function which fills a buffer with (at most) the given
+ * amount of the next bytes of a media stream, and an optional customized user data.
+ * It returns the amount of bytes read, 0 at the end of the stream, or -1 on errors.
+ */
+typedef int AVReadCB(uchar *,int,void *);
+
+/**
+ * @brief Media stream read through a callback, instead of from a file.
+ *
+ * The stream is only read forward (it's never seeked).
+ */
+typedef struct {
+    AVReadCB *arcbRead;
+    void     *lpcbData;
+} AVSource;
+
 /**
  * @brief The AVTools class.
  *
  * Provides basic support for media file operations such as:
  * -Converting from one media container to another
  * -Cutting a media file between two timestamps
- * -Joining video and audio files in a single media file
+ * -Joining video and audio files (or streams) in a single media file
+ * -Scanning a media file, to check it can be fully demuxed
  */
 class AVTools {
 private:
-    QString sLastError;
+    QString             sLastError;
+    QAtomicInteger<int> aiInterrupted;
+    bool       muxStreams(QString,AVSource *,QString,AVSource *,QString);
+    static int checkInterrupt(void *);
+    static int openInput(AVFormatContext **,AVIOContext **,QString,AVSource *);
+    static int readSource(void *,uint8_t *,int);
 public:
     AVTools();
     QString getLastError();
+    void    interrupt();
     bool    saveAs(QString,QString);
     bool    saveAs(QString,QString,float,float);
     bool    saveAs(QString,QString,QString);
+    bool    saveAs(AVSource,AVSource,QString);
+    bool    scan(QString,quint64 &,float &);
 };
 
 #endif // AVTOOLS_H
@@ -0,0 +1,269 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "deciphertools.h"
+
+/**
+ * @brief Extracts the transformations applied by the signature-decoding function of a YT video player.
+ *
+ * The function is expected to split the signature into an array, call the methods of
+ * a single helper object on it (each one reversing, splicing or swapping the array),
+ * and join it back. Anything else makes the extraction fail, so the caller can fall
+ * back to running the JS code itself.
+ *
+ * @param[in]  sPlayerSource  video player JS code
+ * @param[in]  sFunctionName  name of the signature-decoding function
+ * @param[out] dolOps         the transformations, in order
+ *
+ * @return true if every statement of the function was understood
+ */
+bool DecipherTools::compile(QString        sPlayerSource,
+                            QString        sFunctionName,
+                            DecipherOpList &dolOps) {
+    QString                       sParam,sObj;
+    QStringList                   slStatements;
+    QRegularExpression            rxFunction,rxCall;
+    QRegularExpressionMatch       rxmFunctionMatch;
+    QHash<QString,DecipherOpType> hshMethods;
+    dolOps.clear();
+    if(sFunctionName.isEmpty())
+        return false;
+    rxFunction.setPattern(
+        QStringLiteral(
+            "(?:function\\s+%1|[{;,]\\s*%1\\s*=\\s*function|var\\s+%1\\s*=\\s*function)\\s*"
+            "\\(\\s*(?P<param>[a-zA-Z0-9$_]+)\\s*\\)\\s*{(?P<body>[^}]+)}"
+        ).arg(QRegularExpression::escape(sFunctionName))
+    );
+    rxmFunctionMatch=rxFunction.match(sPlayerSource);
+    if(!rxmFunctionMatch.hasMatch())
+        return false;
+    sParam=rxmFunctionMatch.captured(QStringLiteral("param"));
+    slStatements=rxmFunctionMatch.captured(QStringLiteral("body")).split(
+        QLatin1Char(';'),
+        Qt::SplitBehaviorFlags::SkipEmptyParts
+    );
+    for(auto &s:slStatements)
+        s.remove(QRegularExpression(QStringLiteral("\\s+")));
+    // The signature is split first, and joined back last.
+    if(3>slStatements.count()||
+       QStringLiteral("%1=%1.split(\"\")").arg(sParam)!=slStatements.takeFirst()||
+       QStringLiteral("return%1.join(\"\")").arg(sParam)!=slStatements.takeLast())
+        return false;
+    // Every other statement is a call to a method of the helper object.
+    rxCall.setPattern(
+        QStringLiteral(
+            "^(?P<obj>[a-zA-Z0-9$_]+)(?:\\.(?P<method>[a-zA-Z0-9$_]+)|\\[\"(?P<quoted>[a-zA-Z0-9$_]+)\"\\])"
+            "\\(%1(?:,(?P<value>\\d+))?\\)$"
+        ).arg(QRegularExpression::escape(sParam))
+    );
+    for(const auto &s:qAsConst(slStatements)) {
+        DecipherOp              dopOp;
+        QString                 sMethod;
+        QRegularExpressionMatch rxmCallMatch=rxCall.match(s);
+        if(!rxmCallMatch.hasMatch())
+            return false;
+        if(sObj.isEmpty()) {
+            sObj=rxmCallMatch.captured(QStringLiteral("obj"));
+            if(!parseHelper(sPlayerSource,sObj,hshMethods))
+                return false;
+        }
+        else if(sObj!=rxmCallMatch.captured(QStringLiteral("obj")))
+            return false;
+        sMethod=rxmCallMatch.captured(QStringLiteral("method"));
+        if(sMethod.isEmpty())
+            sMethod=rxmCallMatch.captured(QStringLiteral("quoted"));
+        if(!hshMethods.contains(sMethod))
+            return false;
+        dopOp.dotType=hshMethods.value(sMethod);
+        dopOp.iArgument=rxmCallMatch.captured(QStringLiteral("value")).toInt();
+        dolOps.append(dopOp);
+    }
+    return !dolOps.isEmpty();
+}
+
+/**
+ * @brief Decodes a ciphered signature by applying a sequence of transformations to it.
+ *
+ * @param[in] dolOps     the transformations, as extracted by compile()
+ * @param[in] sCiphered  ciphered signature
+ *
+ * @return the deciphered signature
+ */
+QString DecipherTools::decipher(const DecipherOpList &dolOps,
+                                QString              sCiphered) {
+    QString sResult=sCiphered;
+    for(const auto &o:dolOps)
+        switch(o.dotType) {
+            case DecipherOpType::DOT_REVERSE:
+                std::reverse(sResult.begin(),sResult.end());
+                break;
+            case DecipherOpType::DOT_SPLICE:
+                sResult.remove(0,o.iArgument);
+                break;
+            case DecipherOpType::DOT_SWAP:
+                if(!sResult.isEmpty()) {
+                    int iPos=o.iArgument%sResult.length();
+                    std::swap(sResult[0],sResult[iPos]);
+                }
+                break;
+        }
+    return sResult;
+}
+
+/**
+ * @brief Restores a sequence of transformations from its JSON representation.
+ *
+ * @param[in]  jsnOps  the transformations, as saved by toJson()
+ * @param[out] dolOps  the transformations
+ *
+ * @return true if every transformation was valid
+ */
+bool DecipherTools::fromJson(QJsonArray     jsnOps,
+                             DecipherOpList &dolOps) {
+    dolOps.clear();
+    for(const auto &o:qAsConst(jsnOps)) {
+        DecipherOp dopOp;
+        QJsonArray jsnOp=o.toArray();
+        if(2!=jsnOp.count()) {
+            dolOps.clear();
+            return false;
+        }
+        switch(jsnOp.at(0).toInt(-1)) {
+            case DecipherOpType::DOT_REVERSE:
+            case DecipherOpType::DOT_SPLICE:
+            case DecipherOpType::DOT_SWAP:
+                dopOp.dotType=(DecipherOpType)jsnOp.at(0).toInt();
+                break;
+            default:
+                dolOps.clear();
+                return false;
+        }
+        dopOp.iArgument=jsnOp.at(1).toInt();
+        dolOps.append(dopOp);
+    }
+    return true;
+}
+
+/**
+ * @brief Gets the JSON representation of a sequence of transformations.
+ *
+ * @param[in] dolOps  the transformations
+ *
+ * @return an array of [type,argument] pairs
+ */
+QJsonArray DecipherTools::toJson(const DecipherOpList &dolOps) {
+    QJsonArray jsnOps;
+    for(const auto &o:dolOps)
+        jsnOps.append(QJsonArray({(int)o.dotType,o.iArgument}));
+    return jsnOps;
+}
+
+/**
+ * @brief Identifies what every method of the helper object does, from its JS code.
+ *
+ * Every field of the helper object must be a method written in one of the known forms
+ * (whitespace aside), so the native transformations are exactly what the JS code does.
+ * Anything else (another field, or a method doing something slightly different) makes
+ * the whole helper object unrecognized.
+ *
+ * @param[in]  sPlayerSource  video player JS code
+ * @param[in]  sObj           name of the helper object
+ * @param[out] hshMethods     the transformation applied by every method (by name)
+ *
+ * @return true if the helper object was found, and every one of its fields was identified
+ */
+bool DecipherTools::parseHelper(QString                       sPlayerSource,
+                                QString                       sObj,
+                                QHash<QString,DecipherOpType> &hshMethods) {
+    int                     iOffset=0;
+    QString                 sFields;
+    QRegularExpression      rxHelper,rxMethod;
+    QRegularExpressionMatch rxmHelperMatch;
+    hshMethods.clear();
+    rxHelper.setPattern(
+        QStringLiteral("var\\s+%1\\s*=\\s*{(?P<fields>.*?)}\\s*;").
+        arg(QRegularExpression::escape(sObj))
+    );
+    rxHelper.setPatternOptions(QRegularExpression::PatternOption::DotMatchesEverythingOption);
+    rxmHelperMatch=rxHelper.match(sPlayerSource);
+    if(!rxmHelperMatch.hasMatch())
+        return false;
+    sFields=rxmHelperMatch.captured(QStringLiteral("fields"));
+    // The fields are matched one right after the other, so none of them can be skipped.
+    rxMethod.setPattern(
+        QStringLiteral(
+            "\\s*(?P<name>[a-zA-Z0-9$_]+|\"[a-zA-Z0-9$_]+\")\\s*:\\s*"
+            "function\\s*\\((?P<params>[^)]*)\\)\\s*{(?P<code>[^}]*)}\\s*(?:,|$)"
+        )
+    );
+    while(iOffset<sFields.length()) {
+        QString                 sName,sCode,sArray,sArgument;
+        QStringList             slParams;
+        QRegularExpressionMatch rxmMethodMatch=rxMethod.match(
+            sFields,
+            iOffset,
+            QRegularExpression::MatchType::NormalMatch,
+            QRegularExpression::MatchOption::AnchorAtOffsetMatchOption
+        );
+        if(!rxmMethodMatch.hasMatch()||!rxmMethodMatch.capturedLength())
+            return false;
+        iOffset=rxmMethodMatch.capturedEnd();
+        sName=rxmMethodMatch.captured(QStringLiteral("name")).remove(QLatin1Char('"'));
+        slParams=rxmMethodMatch.captured(QStringLiteral("params")).
+                 remove(QRegularExpression(QStringLiteral("\\s+"))).
+                 split(QLatin1Char(','));
+        // Whitespace is only kept (as a single space) between two names.
+        sCode=rxmMethodMatch.captured(QStringLiteral("code")).
+              replace(QRegularExpression(QStringLiteral("\\s+")),QStringLiteral(" ")).
+              remove(QRegularExpression(QStringLiteral("\\s(?=[^a-zA-Z0-9$_])|(?<=[^a-zA-Z0-9$_])\\s"))).
+              trimmed().
+              remove(QRegularExpression(QStringLiteral(";+$")));
+        if(2<slParams.count()||slParams.first().isEmpty())
+            return false;
+        sArray=QRegularExpression::escape(slParams.first());
+        if(QRegularExpression(
+            QStringLiteral("^%1\\.reverse\\(\\)$").arg(sArray)
+        ).match(sCode).hasMatch())
+            hshMethods.insert(sName,DecipherOpType::DOT_REVERSE);
+        else {
+            if(2!=slParams.count()||slParams.last().isEmpty())
+                return false;
+            sArgument=QRegularExpression::escape(slParams.last());
+            if(QRegularExpression(
+                QStringLiteral("^%1\\.splice\\(0,%2\\)$").arg(sArray,sArgument)
+            ).match(sCode).hasMatch())
+                hshMethods.insert(sName,DecipherOpType::DOT_SPLICE);
+            // Swaps come either through a temporary variable, or as nested splices.
+            else if(QRegularExpression(
+                QStringLiteral(
+                    "^var (?P<tmp>[a-zA-Z0-9$_]+)=%1\\[0\\];%1\\[0\\]=%1\\[%2%%1\\.length\\];"
+                    "%1\\[%2%%1\\.length\\]=(?P=tmp)$"
+                ).arg(sArray,sArgument)
+            ).match(sCode).hasMatch()||
+                    QRegularExpression(
+                QStringLiteral(
+                    "^%1\\.splice\\(0,1,%1\\.splice\\(%2%%1\\.length,1,%1\\[0\\]\\)\\[0\\]\\)$"
+                ).arg(sArray,sArgument)
+            ).match(sCode).hasMatch())
+                hshMethods.insert(sName,DecipherOpType::DOT_SWAP);
+            else
+                return false;
+        }
+    }
+    return !hshMethods.isEmpty();
+}
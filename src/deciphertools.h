@@ -0,0 +1,66 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DECIPHERTOOLS_H
+#define DECIPHERTOOLS_H
+
+#include <QtCore>
+
+/**
+ * @brief Available signature transformations.
+ *
+ * The YT signature-decoding function just applies a short sequence of these to the
+ * characters of the ciphered signature.
+ */
+typedef enum {
+    DOT_REVERSE,
+    DOT_SPLICE,
+    DOT_SWAP
+} DecipherOpType;
+
+/**
+ * @brief A single signature transformation, along with its argument (unused by DOT_REVERSE).
+ */
+typedef struct {
+    DecipherOpType dotType;
+    int            iArgument;
+} DecipherOp;
+
+/**
+ * @brief A sequence of signature transformations.
+ */
+typedef QList<DecipherOp> DecipherOpList;
+
+/**
+ * @brief The DecipherTools class.
+ *
+ * Provides a way of extracting the transformations applied by the signature-decoding
+ * function of a YT video player (statically, from its JS code), and applying them
+ * natively, without a JS engine.
+ */
+class DecipherTools {
+private:
+    static bool parseHelper(QString,QString,QHash<QString,DecipherOpType> &);
+public:
+    static bool       compile(QString,QString,DecipherOpList &);
+    static QString    decipher(const DecipherOpList &,QString);
+    static bool       fromJson(QJsonArray,DecipherOpList &);
+    static QJsonArray toJson(const DecipherOpList &);
+};
+
+#endif // DECIPHERTOOLS_H
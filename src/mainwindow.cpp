@@ -29,36 +29,52 @@
  */
 #define DEFAULT_CLIP_SIZE 30
 
+/**
+ * @brief Maximum combined size (in bytes) of the tracks muxed while still downloading.
+ * Bigger ones are downloaded to resumable files first.
+ */
+#define MUX_STREAM_MAX_SIZE 1073741824
+
 /**
  * @brief Callback function receiving the progress from MPDownloader::download().
  *
  * @param[in] ui64Received  amount of bytes received
  * @param[in] ui64Total     total bytes to download
+ * @param[in] ui64Rate      current throughput, in bytes per second
+ * @param[in] i64ETA        estimated time left, in seconds (-1 if unknown)
  * @param[in] lpcbData      raw pointer to the user interface
  */
-void myProgressCallback(quint64 ui64Received,quint64 ui64Total,void *lpcbData) {
+void myProgressCallback(quint64 ui64Received,quint64 ui64Total,quint64 ui64Rate,qint64 i64ETA,void *lpcbData) {
     Ui::MainWindow *myUI=reinterpret_cast<Ui::MainWindow *>(lpcbData);
+    QString        sRate=QStringLiteral("%1/s").arg(UnitsFormat::bytes(ui64Rate));
     if(ui64Total) {
         float flProgress=100.0*ui64Received/ui64Total;
         myUI->stbMain->showMessage(
-            QStringLiteral("%1 of %2 (%3%)").
+            QStringLiteral("%1 of %2 (%3%) - %4 - %5 left").
             arg(
                 UnitsFormat::bytes(ui64Received),
                 UnitsFormat::bytes(ui64Total)
             ).
-            arg(flProgress,0,'f',2)
+            arg(flProgress,0,'f',2).
+            arg(
+                sRate,
+                0>i64ETA?QStringLiteral("?"):UnitsFormat::seconds(i64ETA)
+            )
         );
     }
     else
         myUI->stbMain->showMessage(
-            QStringLiteral("%1").
-            arg(UnitsFormat::bytes(ui64Received))
+            QStringLiteral("%1 - %2").
+            arg(UnitsFormat::bytes(ui64Received),sRate)
         );
 }
 
 MainWindow::MainWindow(QWidget *wgtParent):QMainWindow(wgtParent),ui(new Ui::MainWindow) {
     bFocusIsInVideoURL=false;
+    avtActiveMuxer=nullptr;
     YTScraper::clearVideoDetails(vdCurrentVideoDetails);
+    // Only the media formats actually downloaded are checked against their files.
+    ytsVideoScraper.setLazyValidation(true);
     ui->setupUi(this);
     ui->ledVideoURL->installEventFilter(this);
     ui->ledVideoURL->setFocus();
@@ -109,7 +125,8 @@ MainWindow::~MainWindow() {
 }
 
 void MainWindow::closeEvent(QCloseEvent *evnE) {
-    if(mpdVideoDownloader.isDownloading()) {
+    // The streams being muxed live in btnDownloadHandler(), which must return first.
+    if(nullptr!=avtActiveMuxer||mpdVideoDownloader.isDownloading()||mpdAudioDownloader.isDownloading()) {
         QMessageBox::warning(
             this,
             QStringLiteral(APP_NAME),
@@ -339,10 +356,8 @@ void MainWindow::slot_btnLoad_clicked() {
 }
 
 void MainWindow::slot_btnDownload_clicked() {
-    bool    bSuccess;
     int     iMediaIndex,iAudioIndex;
-    QString sSourceVideo,sSourceAudio,sTargetVideo;
-    AVTools avtMuxer;
+    QString sTargetVideo;
     ui->txtLog->clear();
     iMediaIndex=-1;
     iAudioIndex=-1;
@@ -380,71 +395,23 @@ void MainWindow::slot_btnDownload_clicked() {
             }
         }
     }
-    // Performs the download of the selected media.
-    if(this->btnDownloadHandler(iMediaIndex,sSourceVideo)) {
-        bSuccess=false;
+    // Performs the download of the selected media (muxing its audio track in, as both arrive).
+    if(this->btnDownloadHandler(iMediaIndex,iAudioIndex,sTargetVideo)) {
         ui->txtLog->appendPlainText(
-            QStringLiteral("Source video: %1").arg(sSourceVideo)
+            QStringLiteral("Target video: %1").arg(sTargetVideo)
         );
-        sTargetVideo=QStringLiteral("%1/%2.%3").
-            arg(
-                ui->ledDestinationFolder->text(),
-                vdCurrentVideoDetails.sVideoID,
-                QFileInfo(sSourceVideo).suffix()
+        if(ui->chkSplit->isChecked()) {
+            ui->txtLog->appendPlainText(QStringLiteral("Split requested"));
+            // Cuts the downloaded video according to the user-selected parameters.
+            this->createMultipleClips(
+                sTargetVideo,
+                vdCurrentVideoDetails.uiDuration/1000,
+                ui->spbClipSize->value(),
+                ui->spbIgnoreFirst->value(),
+                ui->spbIgnoreLast->value()
             );
-        if(-1!=iAudioIndex) {
-            ui->txtLog->appendPlainText(QStringLiteral("MUX required"));
-            // Performs the download of the audio track (if it's required).
-            if(this->btnDownloadHandler(iAudioIndex,sSourceAudio)) {
-                ui->txtLog->appendPlainText(
-                    QStringLiteral("Source audio: %1").arg(sSourceAudio)
-                );
-                // Combines the downloaded video and audio files.
-                if(avtMuxer.saveAs(sSourceVideo,sSourceAudio,sTargetVideo)) {
-                    QDir().remove(sSourceVideo);
-                    QDir().remove(sSourceAudio);
-                    ui->txtLog->appendPlainText(
-                        QStringLiteral("Target video: %1").arg(sTargetVideo)
-                    );
-                    ui->txtLog->appendPlainText(QStringLiteral("Mux completed"));
-                    bSuccess=true;
-                }
-                else
-                    ui->txtLog->appendPlainText(
-                        QStringLiteral("MUX process failed: %1").arg(avtMuxer.getLastError())
-                    );
-            }
-
-        }
-        else {
-            QDir().remove(sTargetVideo);
-            QDir().rename(sSourceVideo,sTargetVideo);
-            if(QDir().exists(sTargetVideo)) {
-                ui->txtLog->appendPlainText(
-                    QStringLiteral("Target video: %1").arg(sTargetVideo)
-                );
-                ui->txtLog->appendPlainText(QStringLiteral("Download completed"));
-                bSuccess=true;
-            }
-            else
-                ui->txtLog->appendPlainText(
-                    QStringLiteral("Unable to write to destination folder")
-                );
-        }
-        if(bSuccess) {
-            if(ui->chkSplit->isChecked()) {
-                ui->txtLog->appendPlainText(QStringLiteral("Split requested"));
-                // Cuts the downloaded video according to the user-selected parameters.
-                this->createMultipleClips(
-                    sTargetVideo,
-                    vdCurrentVideoDetails.uiDuration/1000,
-                    ui->spbClipSize->value(),
-                    ui->spbIgnoreFirst->value(),
-                    ui->spbIgnoreLast->value()
-                );
-            }
-            ui->txtLog->appendPlainText(QStringLiteral("** Finished **"));
         }
+        ui->txtLog->appendPlainText(QStringLiteral("** Finished **"));
     }
 }
 
@@ -468,91 +435,247 @@ void MainWindow::slot_chkSplit_stateChanged(int iState) {
 }
 
 /**
- * @brief Processes the download of the selected media format.
+ * @brief Processes the download of the selected media format, along with its audio track.
+ *
+ * A single track is downloaded to a temporary file (so it can be resumed), and then
+ * moved to the destination folder. Otherwise, both tracks are downloaded at the same
+ * time, sharing the connection budget of the process (see MPDScheduler), and muxed
+ * straight into the destination folder as they arrive, with no temporary files.
+ * Streamed tracks cannot be resumed (nor checksummed), so big tracks, and tracks whose
+ * download was interrupted before, go through resumable temporary files instead, and
+ * are muxed once both are complete.
+ * The progress of both tracks is reported combined.
  *
- * @param[in]  iMediaIndex      index of the selected media format
- * @param[out] sDownloadedFile  downloaded filepath (auto-generated)
+ * @param[in]  iMediaIndex   index of the selected media format
+ * @param[in]  iAudioIndex   index of the audio track to mux with (-1 if not required)
+ * @param[out] sTargetVideo  target video filepath (auto-generated)
  *
- * @return true if the download was successful
+ * @return true if the target video was successfully saved
  */
 bool MainWindow::btnDownloadHandler(int     iMediaIndex,
-                                    QString &sDownloadedFile) {
-    bool           bResult=false,
-                   bIsVideo;
-    QString        sExtension,sTempPath;
-    QByteArray     abtVideoContent;
-    QFile          fFile;
-    QWidget        *wgtNextFocus=nullptr;
-    MediaEntry     meEntry;
-    sDownloadedFile.clear();
-    // Cancels the active download if the button is hit before the download finishes.
-    if(mpdVideoDownloader.isDownloading()) {
+                                    int     iAudioIndex,
+                                    QString &sTargetVideo) {
+    bool       bResult=false,
+               bVideoResult=false,
+               bAudioResult=false;
+    QString    sExtension,sSourceVideo;
+    QWidget    *wgtNextFocus=nullptr;
+    QEventLoop evlWait;
+    MediaEntry meEntry;
+    sTargetVideo.clear();
+    // Time windows are set per download, so none is left from the previous one.
+    mpdVideoDownloader.setRange(0);
+    mpdAudioDownloader.setRange(0);
+    // Cancels the active downloads (and the muxing) if the button is hit before they finish.
+    if(nullptr!=avtActiveMuxer||mpdVideoDownloader.isDownloading()||mpdAudioDownloader.isDownloading()) {
+        if(nullptr!=avtActiveMuxer)
+            avtActiveMuxer->interrupt();
         mpdVideoDownloader.cancelDownload();
-        while(mpdVideoDownloader.isDownloading())
-            QApplication::processEvents(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
+        mpdAudioDownloader.cancelDownload();
+        for(auto mpdTrack:{&mpdVideoDownloader,&mpdAudioDownloader})
+            connect(
+                mpdTrack,
+                &MPDownloader::downloadFinished,
+                &evlWait,
+                [this,&evlWait]() {
+                    if(!mpdVideoDownloader.isDownloading()&&!mpdAudioDownloader.isDownloading())
+                        evlWait.quit();
+                }
+            );
+        if(mpdVideoDownloader.isDownloading()||mpdAudioDownloader.isDownloading())
+            evlWait.exec(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
     }
     else
         if(-1!=iMediaIndex) {
             meEntry=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex);
-            bIsVideo=MediaType::MT_AUDIO_ONLY!=meEntry.mtMediaType;
             this->enableControls(false);
             this->setCursor(Qt::CursorShape::BusyCursor);
             ui->btnDownload->setEnabled(true);
             ui->btnDownload->setText(QStringLiteral("Stop"));
-            ui->txtLog->appendPlainText(
-                QStringLiteral("Downloading %1...").
-                arg(bIsVideo?QStringLiteral("video"):QStringLiteral("audio"))
-            );
             ui->stbMain->clearMessage();
-            // Generates the download filepath based on the system's temporary files folder, ...
-            // the associated YT video id and the MIME type of the selected media format.
-            sTempPath=QStandardPaths::standardLocations(
-                QStandardPaths::StandardLocation::TempLocation
-            ).at(0);
             sExtension=MIMETools::mediaExtension(meEntry.sMIMEType);
             if(sExtension.isEmpty())
                 sExtension=QStringLiteral("tmp");
-            sDownloadedFile=QStringLiteral("%1/%2-%3.%4").
-                            arg(
-                                sTempPath,
-                                vdCurrentVideoDetails.sVideoID,
-                                bIsVideo?QStringLiteral("video"):QStringLiteral("audio"),
-                                sExtension
-                            );
-            if(!meEntry.sURL.isEmpty()) {
-                // Performs the download of the associated URL, granting the callback function ...
-                // ... access to the widgets, by passing a pointer to the user interface.
-                if(mpdVideoDownloader.download(
-                    meEntry.sURL,
-                    abtVideoContent,
-                    myProgressCallback,
-                    ui
-                )) {
-                    fFile.setFileName(sDownloadedFile);
-                    if(fFile.open(QFile::OpenModeFlag::WriteOnly)) {
-                        fFile.write(abtVideoContent);
-                        if(QFileDevice::FileError::NoError==fFile.error()) {
-                            ui->txtLog->appendPlainText(QStringLiteral("Success"));
+            sTargetVideo=QStringLiteral("%1/%2.%3").
+                         arg(
+                             ui->ledDestinationFolder->text(),
+                             vdCurrentVideoDetails.sVideoID,
+                             sExtension
+                         );
+            // Nothing is reported for a track which is not required.
+            tdlVideo={this,0,0,0,0,0};
+            tdlAudio=tdlVideo;
+            // Both connections of each track are dropped as soon as the local event loop goes away.
+            for(auto mpdTrack:{&mpdVideoDownloader,&mpdAudioDownloader}) {
+                bool          *bTrackResult=&mpdVideoDownloader==mpdTrack?&bVideoResult:&bAudioResult;
+                TrackDownload *tdlTrack=&mpdVideoDownloader==mpdTrack?&tdlVideo:&tdlAudio;
+                connect(
+                    mpdTrack,
+                    &MPDownloader::downloadProgress,
+                    &evlWait,
+                    [this,tdlTrack](quint64 ui64Received,quint64 ui64Total,quint64 ui64Rate,qint64 i64ETA) {
+                        tdlTrack->ui64Received=ui64Received;
+                        tdlTrack->ui64Total=ui64Total;
+                        tdlTrack->ui64Rate=ui64Rate;
+                        tdlTrack->i64ETA=i64ETA;
+                        this->reportTrackProgress();
+                    }
+                );
+                connect(
+                    mpdTrack,
+                    &MPDownloader::downloadFinished,
+                    &evlWait,
+                    [this,tdlTrack,bTrackResult,&evlWait](bool bSuccess) {
+                        *bTrackResult=bSuccess;
+                        // A finished track no longer adds to the rate nor to the time left.
+                        tdlTrack->ui64Rate=0;
+                        tdlTrack->i64ETA=0;
+                        if(!mpdVideoDownloader.isDownloading()&&!mpdAudioDownloader.isDownloading())
+                            evlWait.quit();
+                    }
+                );
+            }
+            if(-1==iAudioIndex) {
+                if(this->startTrackDownload(iMediaIndex,mpdVideoDownloader,tdlVideo,sSourceVideo)) {
+                    if(mpdVideoDownloader.isDownloading())
+                        evlWait.exec();
+                    if(this->checkTrackDownload(iMediaIndex,mpdVideoDownloader,bVideoResult)&&
+                       this->verifyMediaFile(sSourceVideo,meEntry.uiDuration)) {
+                        ui->txtLog->appendPlainText(
+                            QStringLiteral("Source video: %1").arg(sSourceVideo)
+                        );
+                        QDir().remove(sTargetVideo);
+                        QDir().rename(sSourceVideo,sTargetVideo);
+                        if(QDir().exists(sTargetVideo)) {
+                            ui->txtLog->appendPlainText(QStringLiteral("Download completed"));
                             bResult=true;
                         }
                         else
                             ui->txtLog->appendPlainText(
-                                QStringLiteral("Failed: %1").arg(fFile.errorString())
+                                QStringLiteral("Unable to write to destination folder")
                             );
-                        fFile.close();
                     }
-                    else
+                }
+            }
+            else {
+                bool       bMuxed=false,
+                           bWindowed=false,
+                           bValid,
+                           bStreamed,
+                           bStarted;
+                QString    sSourceAudio;
+                MPDStream  mstVideo,mstAudio;
+                AVTools    avtMuxer;
+                MediaEntry meAudio;
+                ui->txtLog->appendPlainText(QStringLiteral("MUX required"));
+                // How the tracks are fetched depends on their sizes, so both are validated first.
+                bValid=this->validateTrack(iMediaIndex)&&this->validateTrack(iAudioIndex);
+                meEntry=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex);
+                meAudio=vdCurrentVideoDetails.melMediaEntries.at(iAudioIndex);
+                // Clips ignoring the first/last seconds only need the part of the tracks in between.
+                if(bValid&&ui->chkSplit->isChecked()&&(ui->spbIgnoreFirst->value()||ui->spbIgnoreLast->value())) {
+                    double dStartTime=ui->spbIgnoreFirst->value(),
+                           dEndTime=0;
+                    if(ui->spbIgnoreLast->value())
+                        dEndTime=vdCurrentVideoDetails.uiDuration/1000.0-ui->spbIgnoreLast->value();
+                    // Both tracks are cut, or none of them.
+                    bWindowed=this->prepareTrackWindow(iMediaIndex,mpdVideoDownloader,mstVideo,dStartTime,dEndTime)&&
+                              this->prepareTrackWindow(iAudioIndex,mpdAudioDownloader,mstAudio,dStartTime,dEndTime);
+                    if(!bWindowed) {
+                        mstVideo.reset();
+                        mstAudio.reset();
+                        mpdVideoDownloader.setRange(0);
+                        mpdAudioDownloader.setRange(0);
+                    }
+                }
+                // Time windows can only be streamed. Otherwise, only tracks of a known (and not ...
+                // ... too big) size are, unless a previous download of them can be resumed.
+                bStreamed=bWindowed||
+                          (meEntry.ui64Size&&meAudio.ui64Size&&
+                           MUX_STREAM_MAX_SIZE>=meEntry.ui64Size+meAudio.ui64Size&&
+                           !MPDownloader::canResume(this->trackFilePath(iMediaIndex))&&
+                           !MPDownloader::canResume(this->trackFilePath(iAudioIndex)));
+                if(bValid&&!bStreamed)
+                    ui->txtLog->appendPlainText(QStringLiteral("Downloading both tracks before muxing"));
+                bStarted=bValid&&
+                         this->startTrackDownload(iMediaIndex,mpdVideoDownloader,tdlVideo,sSourceVideo,
+                                                  bStreamed?&mstVideo:nullptr)&&
+                         this->startTrackDownload(iAudioIndex,mpdAudioDownloader,tdlAudio,sSourceAudio,
+                                                  bStreamed?&mstAudio:nullptr);
+                // Files are only muxed once both are complete.
+                if(bStarted&&!bStreamed) {
+                    if(mpdVideoDownloader.isDownloading()||mpdAudioDownloader.isDownloading())
+                        evlWait.exec();
+                    bStarted=bVideoResult&&bAudioResult;
+                }
+                if(bStarted) {
+                    QEventLoop evlMux;
+                    QThread    *thrMuxer;
+                    AVReadCB   *arcbStream=[](uchar *lpBuffer,int iSize,void *lpcbData) {
+                        return reinterpret_cast<MPDStream *>(lpcbData)->read(
+                            reinterpret_cast<char *>(lpBuffer),
+                            iSize
+                        );
+                    };
+                    // Combines both tracks (while they're still arriving, if streamed) in a thread ...
+                    // ... of its own: the muxer blocks whenever it gets ahead of a download, ...
+                    // ... while this thread keeps delivering the download events.
+                    thrMuxer=QThread::create(
+                        [&]() {
+                            if(bStreamed)
+                                bMuxed=avtMuxer.saveAs(
+                                    AVSource{arcbStream,&mstVideo},
+                                    AVSource{arcbStream,&mstAudio},
+                                    sTargetVideo
+                                );
+                            else
+                                bMuxed=avtMuxer.saveAs(sSourceVideo,sSourceAudio,sTargetVideo);
+                        }
+                    );
+                    connect(
+                        thrMuxer,
+                        &QThread::finished,
+                        &evlMux,
+                        &QEventLoop::quit
+                    );
+                    // Closing the window (which would destroy the streams) is refused meanwhile, ...
+                    // ... while the Stop button interrupts the muxer.
+                    avtActiveMuxer=&avtMuxer;
+                    thrMuxer->start();
+                    evlMux.exec();
+                    thrMuxer->wait();
+                    delete thrMuxer;
+                    avtActiveMuxer=nullptr;
+                    if(!bMuxed)
                         ui->txtLog->appendPlainText(
-                            QStringLiteral("Failed: %1").arg(fFile.errorString())
+                            QStringLiteral("MUX process failed: %1").arg(avtMuxer.getLastError())
                         );
                 }
+                // Nothing else is needed from the tracks once the muxing stops.
+                if(!bMuxed) {
+                    mpdVideoDownloader.cancelDownload();
+                    mpdAudioDownloader.cancelDownload();
+                }
+                // The streams must outlive the downloads feeding them.
+                if(mpdVideoDownloader.isDownloading()||mpdAudioDownloader.isDownloading())
+                    evlWait.exec();
+                bResult=this->checkTrackDownload(iMediaIndex,mpdVideoDownloader,bVideoResult);
+                bResult=this->checkTrackDownload(iAudioIndex,mpdAudioDownloader,bAudioResult)&&bResult;
+                // A time window is shorter than the declared duration, so only its contents are checked.
+                bResult=bMuxed&&bResult&&this->verifyMediaFile(
+                    sTargetVideo,
+                    bWindowed?0:vdCurrentVideoDetails.uiDuration
+                );
+                if(bResult) {
+                    ui->txtLog->appendPlainText(QStringLiteral("Mux completed"));
+                    // Incomplete files are kept instead, so they can be resumed.
+                    if(!bStreamed) {
+                        QDir().remove(sSourceVideo);
+                        QDir().remove(sSourceAudio);
+                    }
+                }
                 else
-                    if(mpdVideoDownloader.getLastError().isEmpty())
-                        ui->txtLog->appendPlainText(QStringLiteral("Canceled"));
-                    else
-                        ui->txtLog->appendPlainText(
-                            QStringLiteral("Failed: %1").arg(mpdVideoDownloader.getLastError())
-                        );
+                    QDir().remove(sTargetVideo);
             }
             ui->btnDownload->setText(QStringLiteral("Download"));
             ui->stbMain->clearMessage();
@@ -572,6 +695,314 @@ bool MainWindow::btnDownloadHandler(int     iMediaIndex,
     return bResult;
 }
 
+/**
+ * @brief Logs the outcome of a single track download.
+ *
+ * @param[in] iMediaIndex   index of the downloaded media format
+ * @param[in] mpdTrack      downloader which was used for the track
+ * @param[in] bTrackResult  result of the download
+ *
+ * @return true if the track was downloaded successfully
+ */
+bool MainWindow::checkTrackDownload(int          iMediaIndex,
+                                    MPDownloader &mpdTrack,
+                                    bool         bTrackResult) {
+    QString sTrack=MediaType::MT_AUDIO_ONLY!=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex).mtMediaType?
+                   QStringLiteral("Video"):QStringLiteral("Audio");
+    if(bTrackResult)
+        ui->txtLog->appendPlainText(QStringLiteral("%1: Success").arg(sTrack));
+    else
+        if(mpdTrack.getLastError().isEmpty())
+            ui->txtLog->appendPlainText(QStringLiteral("%1: Canceled").arg(sTrack));
+        else
+            ui->txtLog->appendPlainText(
+                QStringLiteral("%1: Failed: %2").arg(sTrack,mpdTrack.getLastError())
+            );
+    return bTrackResult;
+}
+
+/**
+ * @brief Prepares the download of a time window of a track, instead of the whole track.
+ *
+ * Downloads the headers and the index (sidx/Cues) of the track, maps the time window
+ * into the byte range of the segments playing it, and hands the headers over to the
+ * stream, so the segments can follow them. The index itself is left out, since its
+ * offsets would not match the resulting stream.
+ *
+ * @param[in] iMediaIndex  index of the media format to download
+ * @param[in] mpdTrack     downloader to use for the track (its byte range is set here)
+ * @param[in] mstTarget    stream which will receive the track
+ * @param[in] dStartTime   window start, in seconds
+ * @param[in] dEndTime     window end, in seconds (0 for the end of the track)
+ *
+ * @return true if only the window has to be downloaded
+ */
+bool MainWindow::prepareTrackWindow(int          iMediaIndex,
+                                    MPDownloader &mpdTrack,
+                                    MPDStream    &mstTarget,
+                                    double       dStartTime,
+                                    double       dEndTime) {
+    bool             bResult=false;
+    double           dActualStart;
+    quint64          ui64Start,ui64End;
+    QString          sError;
+    QByteArray       abtHeaders;
+    MediaSegmentList mslSegments;
+    MPDownloader     mpdHeaders;
+    MediaEntry       meEntry=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex);
+    QString          sTrack=MediaType::MT_AUDIO_ONLY!=meEntry.mtMediaType?
+                            QStringLiteral("Video"):QStringLiteral("Audio");
+    if(!meEntry.ui64IndexEnd)
+        sError=QStringLiteral("no index available");
+    else {
+        // The headers are small, and everything else waits for them.
+        mpdHeaders.setPriority(MPDPriority::MPDP_INTERACTIVE);
+        mpdHeaders.setRange(0,meEntry.ui64IndexEnd);
+        if(!mpdHeaders.download(meEntry.sURL,abtHeaders))
+            sError=mpdHeaders.getLastError();
+        else if(MediaIndex::parse(abtHeaders,meEntry.ui64IndexStart,meEntry.ui64Size,mslSegments,sError)) {
+            if(MediaIndex::window(mslSegments,dStartTime,dEndTime,ui64Start,ui64End,dActualStart)) {
+                mstTarget.push(abtHeaders.left(meEntry.ui64InitEnd+1));
+                mpdTrack.setRange(ui64Start,ui64End);
+                ui->txtLog->appendPlainText(
+                    QStringLiteral("%1: %2 of %3, from %4").
+                    arg(
+                        sTrack,
+                        UnitsFormat::bytes(meEntry.ui64InitEnd+1+ui64End-ui64Start+1),
+                        UnitsFormat::bytes(meEntry.ui64Size),
+                        UnitsFormat::seconds(dActualStart)
+                    )
+                );
+                bResult=true;
+            }
+            else
+                sError=QStringLiteral("nothing to download in the requested time range");
+        }
+    }
+    if(!bResult)
+        ui->txtLog->appendPlainText(
+            QStringLiteral("%1: Downloading the whole track (%2)").arg(sTrack,sError)
+        );
+    return bResult;
+}
+
+/**
+ * @brief Callback function getting a fresh URL for a track, once the current one expires.
+ *
+ * Every track URL comes from the same load, so they all expire together: the first
+ * track to need it refreshes all of them, and the other tracks just take theirs.
+ *
+ * @param[in,out] sURL      expired URL, replaced with the refreshed one
+ * @param[in]     lpcbData  raw pointer to the track being downloaded
+ *
+ * @return true if the URL was refreshed
+ */
+bool MainWindow::refreshTrackURL(QString &sURL,
+                                 void    *lpcbData) {
+    TrackDownload  *tdlTrack=reinterpret_cast<TrackDownload *>(lpcbData);
+    MainWindow     *winMain=tdlTrack->winMain;
+    MediaEntryList &melEntries=winMain->vdCurrentVideoDetails.melMediaEntries;
+    // Refreshed already, along with another track (refreshes never overlap, see MPDownloader).
+    for(const auto &e:qAsConst(melEntries))
+        if(tdlTrack->uiFormatTag==e.uiFormatTag&&!e.sURL.isEmpty()&&sURL!=e.sURL) {
+            sURL=e.sURL;
+            winMain->ui->txtLog->appendPlainText(QStringLiteral("URL refreshed"));
+            return true;
+        }
+    // Also keeps the loaded details usable for the next download of any format.
+    if(!winMain->ytsVideoScraper.refreshMediaURLs(
+        winMain->vdCurrentVideoDetails.sVideoID,
+        tdlTrack->uiFormatTag,
+        melEntries
+    )) {
+        winMain->ui->txtLog->appendPlainText(
+            QStringLiteral("Unable to refresh the URL: %1").
+            arg(winMain->ytsVideoScraper.getLastError())
+        );
+        return false;
+    }
+    for(const auto &e:qAsConst(melEntries))
+        if(tdlTrack->uiFormatTag==e.uiFormatTag)
+            sURL=e.sURL;
+    winMain->ui->txtLog->appendPlainText(QStringLiteral("URL refreshed"));
+    return true;
+}
+
+/**
+ * @brief Shows the combined progress of the tracks being downloaded.
+ *
+ * The rates add up, while the time left is the one of the slowest track.
+ */
+void MainWindow::reportTrackProgress() {
+    quint64 ui64Received=0,ui64Total=0,ui64Rate=0;
+    qint64  i64ETA=0;
+    for(const auto tdlTrack:{&tdlVideo,&tdlAudio}) {
+        ui64Received+=tdlTrack->ui64Received;
+        ui64Total+=tdlTrack->ui64Total;
+        ui64Rate+=tdlTrack->ui64Rate;
+        if(0>tdlTrack->i64ETA||0>i64ETA)
+            i64ETA=-1;
+        else
+            i64ETA=qMax(i64ETA,tdlTrack->i64ETA);
+    }
+    // Any track with an unknown size makes the combined total unknown too.
+    if((tdlVideo.ui64Received&&!tdlVideo.ui64Total)||(tdlAudio.ui64Received&&!tdlAudio.ui64Total))
+        ui64Total=0;
+    myProgressCallback(ui64Received,ui64Total,ui64Rate,i64ETA,ui);
+}
+
+/**
+ * @brief Starts (without waiting) the download of a single track, either to a temporary
+ * file (in the destination folder) or to a stream.
+ *
+ * @param[in]  iMediaIndex      index of the media format to download
+ * @param[in]  mpdTrack         downloader to use for the track
+ * @param[out] tdlTrack         progress of the track, reset here
+ * @param[out] sDownloadedFile  downloaded filepath (auto-generated, empty for streams)
+ * @param[in]  mstTarget        stream receiving the track (or nullptr, for a temporary file)
+ *
+ * @return true if the download was started
+ */
+bool MainWindow::startTrackDownload(int           iMediaIndex,
+                                    MPDownloader  &mpdTrack,
+                                    TrackDownload &tdlTrack,
+                                    QString       &sDownloadedFile,
+                                    MPDStream     *mstTarget) {
+    bool       bIsVideo,bStarted;
+    MediaEntry meEntry;
+    sDownloadedFile.clear();
+    if(!this->validateTrack(iMediaIndex))
+        return false;
+    meEntry=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex);
+    bIsVideo=MediaType::MT_AUDIO_ONLY!=meEntry.mtMediaType;
+    ui->txtLog->appendPlainText(
+        QStringLiteral("Downloading %1...").
+        arg(bIsVideo?QStringLiteral("video"):QStringLiteral("audio"))
+    );
+    tdlTrack.uiFormatTag=meEntry.uiFormatTag;
+    tdlTrack.ui64Received=0;
+    tdlTrack.ui64Total=meEntry.ui64Size;
+    tdlTrack.ui64Rate=0;
+    tdlTrack.i64ETA=-1;
+    // The media URLs expire, so long downloads get a fresh one for the same format tag.
+    mpdTrack.setURLRefresh(refreshTrackURL,&tdlTrack);
+    if(nullptr!=mstTarget)
+        bStarted=mpdTrack.startDownload(meEntry.sURL,mstTarget);
+    else {
+        sDownloadedFile=this->trackFilePath(iMediaIndex);
+        // The media URLs change on every load, so the video id and format tag ...
+        // ... are what allow resuming an interrupted download of the same media.
+        mpdTrack.setResumeKey(
+            QStringLiteral("%1/%2").
+            arg(vdCurrentVideoDetails.sVideoID).
+            arg(meEntry.uiFormatTag)
+        );
+        mpdTrack.setVerify(ui->chkVerify->isChecked());
+        // The contents are streamed straight into the downloaded file.
+        bStarted=mpdTrack.startDownload(meEntry.sURL,sDownloadedFile);
+    }
+    if(!bStarted) {
+        ui->txtLog->appendPlainText(
+            QStringLiteral("Failed: %1").arg(mpdTrack.getLastError())
+        );
+        sDownloadedFile.clear();
+    }
+    return bStarted;
+}
+
+/**
+ * @brief Gets the path of the temporary file a track is downloaded to.
+ *
+ * The path is based on the destination folder, the associated YT video id and the MIME
+ * type of the media format, so an interrupted download is found again (and resumed).
+ * Being on the same volume as the target, the file is moved there with a plain rename,
+ * instead of being copied all over again.
+ *
+ * @param[in] iMediaIndex  index of the media format
+ *
+ * @return the temporary filepath
+ */
+QString MainWindow::trackFilePath(int iMediaIndex) {
+    QString    sExtension;
+    MediaEntry meEntry=vdCurrentVideoDetails.melMediaEntries.at(iMediaIndex);
+    sExtension=MIMETools::mediaExtension(meEntry.sMIMEType);
+    if(sExtension.isEmpty())
+        sExtension=QStringLiteral("tmp");
+    return QStringLiteral("%1/%2-%3.%4").
+           arg(
+               ui->ledDestinationFolder->text(),
+               vdCurrentVideoDetails.sVideoID,
+               MediaType::MT_AUDIO_ONLY!=meEntry.mtMediaType?
+               QStringLiteral("video"):QStringLiteral("audio"),
+               sExtension
+           );
+}
+
+/**
+ * @brief Validates the media entry of a track (when it was left for later), keeping the
+ * completed entry in the current video details: it's only checked once per load.
+ *
+ * @param[in] iMediaIndex  index of the media format
+ *
+ * @return true if the media format is downloadable
+ */
+bool MainWindow::validateTrack(int iMediaIndex) {
+    MediaEntry &meEntry=vdCurrentVideoDetails.melMediaEntries[iMediaIndex];
+    if(meEntry.sURL.isEmpty())
+        return false;
+    if(!ytsVideoScraper.validateMediaEntry(meEntry)) {
+        ui->txtLog->appendPlainText(
+            QStringLiteral("Failed: %1").arg(ytsVideoScraper.getLastError())
+        );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that a downloaded (or muxed) media file is usable, when requested.
+ *
+ * A quick demux pass tells whether the whole file can be read, and its duration
+ * is compared with the declared one.
+ *
+ * @param[in] sFile       media filepath
+ * @param[in] uiDuration  declared duration, in milliseconds (0 if unknown)
+ *
+ * @return true if the file was verified (or if no verification was requested)
+ */
+bool MainWindow::verifyMediaFile(QString sFile,
+                                 uint    uiDuration) {
+    bool    bResult=false;
+    quint64 ui64Packets;
+    float   fDuration;
+    AVTools avtScanner;
+    if(!ui->chkVerify->isChecked())
+        return true;
+    if(!avtScanner.scan(sFile,ui64Packets,fDuration))
+        ui->txtLog->appendPlainText(
+            QStringLiteral("Verification failed: %1").arg(avtScanner.getLastError())
+        );
+    // The declared duration is not exact, so a small difference is tolerated.
+    else if(uiDuration&&
+            qAbs(fDuration*1000-uiDuration)>qMax(1000u,uiDuration/100))
+        ui->txtLog->appendPlainText(
+            QStringLiteral("Verification failed: %1 long, %2 expected").
+            arg(
+                UnitsFormat::seconds(fDuration),
+                UnitsFormat::seconds(uiDuration/1000)
+            )
+        );
+    else {
+        ui->txtLog->appendPlainText(
+            QStringLiteral("Verified: %1 packets, %2").
+            arg(ui64Packets).
+            arg(UnitsFormat::seconds(fDuration))
+        );
+        bResult=true;
+    }
+    return bResult;
+}
+
 /**
  * @brief Splits a media file in multiple standalone clips of same duration.
  *
@@ -658,6 +1089,7 @@ void MainWindow::enableControls(bool bEnable) {
     ui->ledDestinationFolder->setEnabled(bEnable);
     ui->cboMediaFormats->setEnabled(bEnable);
     ui->chkSplit->setEnabled(bEnable);
+    ui->chkVerify->setEnabled(bEnable);
     ui->spbIgnoreFirst->setEnabled(bEnable&&ui->chkSplit->isChecked());
     ui->spbClipSize->setEnabled(bEnable&&ui->chkSplit->isChecked());
     ui->spbIgnoreLast->setEnabled(bEnable&&ui->chkSplit->isChecked());
@@ -672,6 +1104,8 @@ void MainWindow::showThumbnail() {
     if(!vdCurrentVideoDetails.sThumbnail.isEmpty()) {
         QByteArray   abtThumbnail;
         MPDownloader mpdThumbnail;
+        // The user is waiting for it, so it goes ahead of any running download.
+        mpdThumbnail.setPriority(MPDPriority::MPDP_INTERACTIVE);
         // Downloads the thumbnail's binary content.
         if(mpdThumbnail.download(vdCurrentVideoDetails.sThumbnail,abtThumbnail)) {
             // Creates a QIcon object with the downloaded content.
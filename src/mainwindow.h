@@ -24,6 +24,7 @@
 #include <QFileDialog>
 #include <QDesktopServices>
 #include "avtools.h"
+#include "mediaindex.h"
 #include "mpdownloader.h"
 #include "unitsformat.h"
 #include "ytscraper.h"
@@ -49,14 +50,37 @@ private slots:
     void slot_btnVideoThumbnail_clicked();
     void slot_chkSplit_stateChanged(int);
 private:
+    /**
+     * @brief Progress of a single track (video or audio) being downloaded.
+     */
+    typedef struct {
+        MainWindow *winMain;
+        uint       uiFormatTag;
+        quint64    ui64Received;
+        quint64    ui64Total;
+        quint64    ui64Rate;
+        qint64     i64ETA;
+    } TrackDownload;
     VideoDetails   vdCurrentVideoDetails;
     YTScraper      ytsVideoScraper;
     MPDownloader   mpdVideoDownloader;
+    MPDownloader   mpdAudioDownloader;
+    TrackDownload  tdlVideo;
+    TrackDownload  tdlAudio;
     bool           bFocusIsInVideoURL;
+    AVTools        *avtActiveMuxer;
     Ui::MainWindow *ui;
-    bool btnDownloadHandler(int,QString &);
+    static bool refreshTrackURL(QString &,void *);
+    bool btnDownloadHandler(int,int,QString &);
+    bool checkTrackDownload(int,MPDownloader &,bool);
     void createMultipleClips(QString,uint,uint,uint=0,uint=0);
     void enableControls(bool=true);
+    bool prepareTrackWindow(int,MPDownloader &,MPDStream &,double,double);
+    void reportTrackProgress();
     void showThumbnail();
+    bool startTrackDownload(int,MPDownloader &,TrackDownload &,QString &,MPDStream * =nullptr);
+    QString trackFilePath(int);
+    bool validateTrack(int);
+    bool verifyMediaFile(QString,uint);
 };
 #endif // MAINWINDOW_H
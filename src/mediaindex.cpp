@@ -0,0 +1,354 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mediaindex.h"
+
+/**
+ * @brief MP4 box type of the segment index.
+ */
+#define MI_SIDX_BOX_TYPE "sidx"
+
+/**
+ * @brief EBML element ids (WebM), as they're found in the stream (marker included).
+ */
+#define MI_EBML_HEADER_ID           0x1A45DFA3
+#define MI_EBML_SEGMENT_ID          0x18538067
+#define MI_EBML_INFO_ID             0x1549A966
+#define MI_EBML_TIMECODE_SCALE_ID   0x2AD7B1
+#define MI_EBML_CLUSTER_ID          0x1F43B675
+#define MI_EBML_CUES_ID             0x1C53BB6B
+#define MI_EBML_CUE_POINT_ID        0xBB
+#define MI_EBML_CUE_TIME_ID         0xB3
+#define MI_EBML_CUE_POSITIONS_ID    0xB7
+#define MI_EBML_CLUSTER_POSITION_ID 0xF1
+
+/**
+ * @brief Default WebM timecode scale (1 ms), in nanoseconds.
+ */
+#define MI_DEFAULT_TIMECODE_SCALE 1000000
+
+/**
+ * @brief Reads the index of a fragmented media resource into a list of segments.
+ *
+ * @param[in]  abtHeaders      the first bytes of the resource, up to the end of the index
+ * @param[in]  ui64IndexStart  offset of the index (sidx box or Cues element)
+ * @param[in]  ui64Size        total size of the resource
+ * @param[out] mslSegments     segments found in the index
+ * @param[out] sError          the reason why the index could not be read (if any)
+ *
+ * @return true if the index was read, with at least one segment
+ */
+bool MediaIndex::parse(QByteArray       abtHeaders,
+                       quint64          ui64IndexStart,
+                       quint64          ui64Size,
+                       MediaSegmentList &mslSegments,
+                       QString          &sError) {
+    bool           bResult=false;
+    QByteArrayView abvHeaders(abtHeaders);
+    mslSegments.clear();
+    sError.clear();
+    if(ui64IndexStart+8>(quint64)abvHeaders.size())
+        sError=QStringLiteral("Incomplete index");
+    // Tells the container from the index signature.
+    else if(!memcmp(abvHeaders.data()+ui64IndexStart+4,MI_SIDX_BOX_TYPE,4))
+        bResult=parseSIDX(abvHeaders,ui64IndexStart,mslSegments,sError);
+    else if(MI_EBML_CUES_ID==readUInt(abvHeaders,ui64IndexStart,4))
+        bResult=parseCues(abvHeaders,ui64IndexStart,ui64Size,mslSegments,sError);
+    else
+        sError=QStringLiteral("Unknown index format");
+    if(bResult&&mslSegments.isEmpty()) {
+        sError=QStringLiteral("Empty index");
+        bResult=false;
+    }
+    return bResult;
+}
+
+/**
+ * @brief Reads the WebM Cues element, one segment per cue point (cluster).
+ *
+ * The cluster positions are relative to the Segment data, and the cue times are
+ * scaled by the TimecodeScale found in the Segment Info (both in the headers).
+ *
+ * @param[in]  abvHeaders      the first bytes of the resource, up to the end of the index
+ * @param[in]  ui64IndexStart  offset of the Cues element
+ * @param[in]  ui64Size        total size of the resource
+ * @param[out] mslSegments     segments found in the index
+ * @param[out] sError          the reason why the index could not be read (if any)
+ *
+ * @return true if the index was read
+ */
+bool MediaIndex::parseCues(QByteArrayView   abvHeaders,
+                           quint64          ui64IndexStart,
+                           quint64          ui64Size,
+                           MediaSegmentList &mslSegments,
+                           QString          &sError) {
+    qint64  i64Pos=0,i64End;
+    quint64 ui64Id,ui64Length,ui64SegmentData=0,ui64Scale=MI_DEFAULT_TIMECODE_SCALE;
+    QList<QPair<quint64,quint64>> lstCues;
+    // Skips the EBML header, and enters the Segment.
+    if(!readEBMLElement(abvHeaders,i64Pos,ui64Id,ui64Length)||MI_EBML_HEADER_ID!=ui64Id) {
+        sError=QStringLiteral("Missing EBML header");
+        return false;
+    }
+    i64Pos+=ui64Length;
+    if(!readEBMLElement(abvHeaders,i64Pos,ui64Id,ui64Length)||MI_EBML_SEGMENT_ID!=ui64Id) {
+        sError=QStringLiteral("Missing Segment element");
+        return false;
+    }
+    ui64SegmentData=i64Pos;
+    // Looks for the timecode scale, before the index.
+    while((quint64)i64Pos<ui64IndexStart&&readEBMLElement(abvHeaders,i64Pos,ui64Id,ui64Length)) {
+        if(MI_EBML_CLUSTER_ID==ui64Id)
+            break;
+        if(MI_EBML_INFO_ID==ui64Id) {
+            qint64 i64Info=i64Pos;
+            i64End=qMin<qint64>(i64Pos+ui64Length,abvHeaders.size());
+            while(i64Info<i64End&&readEBMLElement(abvHeaders,i64Info,ui64Id,ui64Length)) {
+                if(MI_EBML_TIMECODE_SCALE_ID==ui64Id)
+                    ui64Scale=readUInt(abvHeaders,i64Info,ui64Length);
+                i64Info+=ui64Length;
+            }
+            break;
+        }
+        i64Pos+=ui64Length;
+    }
+    // Collects the cue points: (time, cluster position) pairs.
+    i64Pos=ui64IndexStart;
+    if(!readEBMLElement(abvHeaders,i64Pos,ui64Id,ui64Length)||MI_EBML_CUES_ID!=ui64Id) {
+        sError=QStringLiteral("Missing Cues element");
+        return false;
+    }
+    i64End=qMin<qint64>(i64Pos+ui64Length,abvHeaders.size());
+    while(i64Pos<i64End&&readEBMLElement(abvHeaders,i64Pos,ui64Id,ui64Length)) {
+        if(MI_EBML_CUE_POINT_ID==ui64Id) {
+            bool    bHasPosition=false;
+            qint64  i64Point=i64Pos,
+                    i64PointEnd=qMin<qint64>(i64Pos+ui64Length,i64End);
+            quint64 ui64Time=0,ui64Position=0;
+            while(i64Point<i64PointEnd&&readEBMLElement(abvHeaders,i64Point,ui64Id,ui64Length)) {
+                if(MI_EBML_CUE_TIME_ID==ui64Id)
+                    ui64Time=readUInt(abvHeaders,i64Point,ui64Length);
+                // Only the first track position matters: they all point to the same cluster.
+                else if(MI_EBML_CUE_POSITIONS_ID==ui64Id&&!bHasPosition) {
+                    qint64  i64Track=i64Point;
+                    quint64 ui64TrackId,ui64TrackLength;
+                    while(i64Track<i64Point+(qint64)ui64Length&&
+                          readEBMLElement(abvHeaders,i64Track,ui64TrackId,ui64TrackLength)) {
+                        if(MI_EBML_CLUSTER_POSITION_ID==ui64TrackId) {
+                            ui64Position=readUInt(abvHeaders,i64Track,ui64TrackLength);
+                            bHasPosition=true;
+                        }
+                        i64Track+=ui64TrackLength;
+                    }
+                }
+                i64Point+=ui64Length;
+            }
+            if(bHasPosition)
+                lstCues.append(qMakePair(ui64Time,ui64SegmentData+ui64Position));
+        }
+        i64Pos+=ui64Length;
+    }
+    // Every cluster goes up to the next one (the last one, up to the end of the resource).
+    for(int iK=0;iK<lstCues.count();iK++) {
+        MediaSegment msSegment;
+        msSegment.ui64Start=lstCues.at(iK).second;
+        msSegment.dStartTime=(double)lstCues.at(iK).first*ui64Scale/1e9;
+        if(iK+1<lstCues.count()) {
+            msSegment.ui64End=lstCues.at(iK+1).second-1;
+            msSegment.dEndTime=(double)lstCues.at(iK+1).first*ui64Scale/1e9;
+        }
+        else {
+            msSegment.ui64End=ui64Size-1;
+            msSegment.dEndTime=qInf();
+        }
+        if(msSegment.ui64Start>msSegment.ui64End||msSegment.ui64End>=ui64Size) {
+            sError=QStringLiteral("Invalid cue point: %1").arg(msSegment.ui64Start);
+            mslSegments.clear();
+            return false;
+        }
+        mslSegments.append(msSegment);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the MP4 segment index box, one segment per referenced fragment.
+ *
+ * The fragment offsets are relative to the first byte after the box.
+ *
+ * @param[in]  abvHeaders      the first bytes of the resource, up to the end of the index
+ * @param[in]  ui64IndexStart  offset of the sidx box
+ * @param[out] mslSegments     segments found in the index
+ * @param[out] sError          the reason why the index could not be read (if any)
+ *
+ * @return true if the index was read
+ */
+bool MediaIndex::parseSIDX(QByteArrayView   abvHeaders,
+                           quint64          ui64IndexStart,
+                           MediaSegmentList &mslSegments,
+                           QString          &sError) {
+    uint    uiVersion,uiTimescale,uiCount;
+    qint64  i64Pos=ui64IndexStart;
+    quint64 ui64BoxSize,ui64Time,ui64Offset;
+    ui64BoxSize=readUInt(abvHeaders,i64Pos,4);
+    i64Pos+=8;
+    if(1==ui64BoxSize) {
+        ui64BoxSize=readUInt(abvHeaders,i64Pos,8);
+        i64Pos+=8;
+    }
+    if(i64Pos+12>abvHeaders.size()) {
+        sError=QStringLiteral("Incomplete sidx box");
+        return false;
+    }
+    // Skips the flags and the reference id.
+    uiVersion=(uchar)abvHeaders.at(i64Pos);
+    i64Pos+=8;
+    uiTimescale=readUInt(abvHeaders,i64Pos,4);
+    i64Pos+=4;
+    if(0==uiVersion) {
+        ui64Time=readUInt(abvHeaders,i64Pos,4);
+        ui64Offset=readUInt(abvHeaders,i64Pos+4,4);
+        i64Pos+=8;
+    }
+    else {
+        ui64Time=readUInt(abvHeaders,i64Pos,8);
+        ui64Offset=readUInt(abvHeaders,i64Pos+8,8);
+        i64Pos+=16;
+    }
+    uiCount=readUInt(abvHeaders,i64Pos+2,2);
+    i64Pos+=4;
+    ui64Offset+=ui64IndexStart+ui64BoxSize;
+    if(!uiTimescale||(quint64)i64Pos+12*uiCount>(quint64)abvHeaders.size()) {
+        sError=QStringLiteral("Invalid sidx box");
+        return false;
+    }
+    for(uint uiK=0;uiK<uiCount;uiK++,i64Pos+=12) {
+        MediaSegment msSegment;
+        quint64      ui64Reference=readUInt(abvHeaders,i64Pos,4),
+                     ui64Duration=readUInt(abvHeaders,i64Pos+4,4);
+        // References to other sidx boxes (hierarchical indexes) are not followed.
+        if(ui64Reference&0x80000000) {
+            sError=QStringLiteral("Hierarchical sidx boxes are not supported");
+            mslSegments.clear();
+            return false;
+        }
+        msSegment.ui64Start=ui64Offset;
+        msSegment.ui64End=ui64Offset+(ui64Reference&0x7FFFFFFF)-1;
+        msSegment.dStartTime=(double)ui64Time/uiTimescale;
+        msSegment.dEndTime=(double)(ui64Time+ui64Duration)/uiTimescale;
+        mslSegments.append(msSegment);
+        ui64Offset=msSegment.ui64End+1;
+        ui64Time+=ui64Duration;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the id and the data size of an EBML element.
+ *
+ * @param[in]     abvData     the bytes containing the element
+ * @param[in,out] i64Pos      offset of the element, moved to the start of its data
+ * @param[out]    ui64Id      element id (marker included)
+ * @param[out]    ui64Length  data size (the rest of the bytes, when it's unknown)
+ *
+ * @return true if the element header was complete
+ */
+bool MediaIndex::readEBMLElement(QByteArrayView abvData,
+                                 qint64         &i64Pos,
+                                 quint64        &ui64Id,
+                                 quint64        &ui64Length) {
+    for(int iK=0;iK<2;iK++) {
+        int     iWidth;
+        uchar   ucFirst;
+        quint64 ui64Value;
+        if(i64Pos>=abvData.size())
+            return false;
+        ucFirst=abvData.at(i64Pos);
+        if(!ucFirst)
+            return false;
+        // The number of leading zeros tells the width of the variable-size integer.
+        iWidth=1;
+        while(!(ucFirst&(0x80>>(iWidth-1))))
+            iWidth++;
+        if(i64Pos+iWidth>abvData.size())
+            return false;
+        ui64Value=readUInt(abvData,i64Pos,iWidth);
+        i64Pos+=iWidth;
+        if(!iK)
+            ui64Id=ui64Value;
+        else {
+            // Sizes don't include the marker, and all ones means "unknown".
+            ui64Value&=~(Q_UINT64_C(1)<<(7*iWidth));
+            if(ui64Value==(Q_UINT64_C(1)<<(7*iWidth))-1)
+                ui64Value=abvData.size()-i64Pos;
+            ui64Length=ui64Value;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a big-endian unsigned integer.
+ *
+ * @param[in] abvData   the bytes containing the integer
+ * @param[in] i64Pos    offset of the integer
+ * @param[in] ui64Size  size of the integer, in bytes (up to 8)
+ *
+ * @return the integer, or 0 if it's out of bounds
+ */
+quint64 MediaIndex::readUInt(QByteArrayView abvData,
+                             qint64         i64Pos,
+                             quint64        ui64Size) {
+    quint64 ui64Value=0;
+    if(8<ui64Size||i64Pos+(qint64)ui64Size>abvData.size())
+        return 0;
+    for(quint64 ui64K=0;ui64K<ui64Size;ui64K++)
+        ui64Value=(ui64Value<<8)|(uchar)abvData.at(i64Pos+ui64K);
+    return ui64Value;
+}
+
+/**
+ * @brief Maps a time range into the byte range of the segments playing it.
+ *
+ * @param[in]  mslSegments   segments of the resource
+ * @param[in]  dStartTime    range start, in seconds
+ * @param[in]  dEndTime      range end, in seconds (0 for the end of the resource)
+ * @param[out] ui64Start     first byte of the first segment in the range
+ * @param[out] ui64End       last byte of the last segment in the range
+ * @param[out] dActualStart  start time of the first segment in the range
+ *
+ * @return true if the time range has at least one segment
+ */
+bool MediaIndex::window(const MediaSegmentList &mslSegments,
+                        double                 dStartTime,
+                        double                 dEndTime,
+                        quint64                &ui64Start,
+                        quint64                &ui64End,
+                        double                 &dActualStart) {
+    bool bResult=false;
+    for(const auto &s:mslSegments)
+        if(s.dEndTime>dStartTime&&(0>=dEndTime||s.dStartTime<dEndTime)) {
+            if(!bResult) {
+                ui64Start=s.ui64Start;
+                dActualStart=s.dStartTime;
+                bResult=true;
+            }
+            ui64End=s.ui64End;
+        }
+    return bResult;
+}
@@ -0,0 +1,60 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEDIAINDEX_H
+#define MEDIAINDEX_H
+
+#include <QtCore>
+
+/**
+ * @brief Media segment details.
+ *
+ * Holds the byte range (inclusive) of a single segment of a fragmented media
+ * resource (a MP4 fragment or a WebM cluster), and the time span it plays, in seconds.
+ */
+typedef struct {
+    quint64 ui64Start;
+    quint64 ui64End;
+    double  dStartTime;
+    double  dEndTime;
+} MediaSegment;
+
+/**
+ * @brief A list of media segments, in playing order.
+ */
+typedef QList<MediaSegment> MediaSegmentList;
+
+/**
+ * @brief The MediaIndex class.
+ *
+ * Provides support for reading the index of fragmented media resources (the MP4
+ * "sidx" box or the WebM Cues element), so a time range can be mapped into the
+ * byte range to download, without downloading the whole resource.
+ */
+class MediaIndex {
+private:
+    static bool    parseCues(QByteArrayView,quint64,quint64,MediaSegmentList &,QString &);
+    static bool    parseSIDX(QByteArrayView,quint64,MediaSegmentList &,QString &);
+    static bool    readEBMLElement(QByteArrayView,qint64 &,quint64 &,quint64 &);
+    static quint64 readUInt(QByteArrayView,qint64,quint64);
+public:
+    static bool parse(QByteArray,quint64,quint64,MediaSegmentList &,QString &);
+    static bool window(const MediaSegmentList &,double,double,quint64 &,quint64 &,double &);
+};
+
+#endif // MEDIAINDEX_H
@@ -0,0 +1,104 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mpdbufferpool.h"
+
+/**
+ * @brief Creates an empty pool. Buffers are allocated on demand.
+ *
+ * @param[in] iSize     size (in bytes) of every buffer
+ * @param[in] iMaxKept  maximum number of free buffers kept for reuse
+ */
+MPDBufferPool::MPDBufferPool(int iSize,
+                             int iMaxKept) {
+    iBufferSize=qMax(1,iSize);
+    iMaxFree=qMax(0,iMaxKept);
+    ui64Hits=0;
+    ui64Misses=0;
+    ui64BytesInFlight=0;
+    ui64PeakInFlight=0;
+    lstFree.clear();
+}
+
+/**
+ * @brief Takes a buffer from the pool, allocating a new one if there are none left.
+ *
+ * @return a buffer of bufferSize() bytes (its contents are undefined)
+ */
+QByteArray MPDBufferPool::acquire() {
+    QMutexLocker mtlPool(&mtxPool);
+    if(!lstFree.isEmpty()) {
+        ui64Hits++;
+        return lstFree.takeLast();
+    }
+    ui64Misses++;
+    return QByteArray(iBufferSize,Qt::Initialization::Uninitialized);
+}
+
+/**
+ * @brief Gets the size of every buffer in the pool.
+ *
+ * @return the buffer size, in bytes
+ */
+int MPDBufferPool::bufferSize() {
+    return iBufferSize;
+}
+
+/**
+ * @brief Gets the pool counters, for tuning purposes.
+ *
+ * @return the current counters
+ */
+MPDPoolStats MPDBufferPool::getStats() {
+    MPDPoolStats mpsStats;
+    QMutexLocker mtlPool(&mtxPool);
+    mpsStats.ui64Hits=ui64Hits;
+    mpsStats.ui64Misses=ui64Misses;
+    mpsStats.ui64BytesInFlight=ui64BytesInFlight;
+    mpsStats.ui64PeakInFlight=ui64PeakInFlight;
+    mpsStats.iFreeBuffers=lstFree.count();
+    return mpsStats;
+}
+
+/**
+ * @brief Gives a buffer back to the pool.
+ *
+ * Buffers beyond the pool limit (or resized by the caller) are just freed.
+ *
+ * @param[in,out] abtBuffer  the buffer (emptied on return)
+ */
+void MPDBufferPool::release(QByteArray &abtBuffer) {
+    QMutexLocker mtlPool(&mtxPool);
+    if(iBufferSize==abtBuffer.size()&&iMaxFree>lstFree.count())
+        lstFree.append(abtBuffer);
+    abtBuffer=QByteArray();
+}
+
+/**
+ * @brief Updates the amount of bytes read from the network and not written yet.
+ *
+ * @param[in] i64Delta  bytes just read (positive) or just written (negative)
+ */
+void MPDBufferPool::trackInFlight(qint64 i64Delta) {
+    QMutexLocker mtlPool(&mtxPool);
+    if(0>i64Delta&&(quint64)-i64Delta>ui64BytesInFlight)
+        ui64BytesInFlight=0;
+    else
+        ui64BytesInFlight+=i64Delta;
+    ui64PeakInFlight=qMax(ui64PeakInFlight,ui64BytesInFlight);
+}
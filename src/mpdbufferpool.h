@@ -0,0 +1,65 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MPDBUFFERPOOL_H
+#define MPDBUFFERPOOL_H
+
+#include <QtCore>
+
+/**
+ * @brief Buffer pool counters.
+ *
+ * Hits are buffers handed out from the pool, misses are buffers which had to be
+ * allocated. Bytes in flight are the bytes read from the network and still waiting
+ * to reach their target.
+ */
+typedef struct {
+    quint64 ui64Hits;
+    quint64 ui64Misses;
+    quint64 ui64BytesInFlight;
+    quint64 ui64PeakInFlight;
+    int     iFreeBuffers;
+} MPDPoolStats;
+
+/**
+ * @brief The MPDBufferPool class
+ *
+ * Keeps a set of fixed-size buffers, so the bytes read from the network do not need
+ * a new allocation every time. Released buffers go back to the pool (up to a limit),
+ * ready to be reused. Every method is thread-safe.
+ */
+class MPDBufferPool {
+private:
+    int               iBufferSize;
+    int               iMaxFree;
+    quint64           ui64Hits;
+    quint64           ui64Misses;
+    quint64           ui64BytesInFlight;
+    quint64           ui64PeakInFlight;
+    QMutex            mtxPool;
+    QList<QByteArray> lstFree;
+public:
+    MPDBufferPool(int,int);
+    QByteArray   acquire();
+    int          bufferSize();
+    MPDPoolStats getStats();
+    void         release(QByteArray &);
+    void         trackInFlight(qint64);
+};
+
+#endif // MPDBUFFERPOOL_H
@@ -0,0 +1,363 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mpddiskwriter.h"
+
+#if defined(Q_OS_UNIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Number of slots in the write requests ring.
+ *
+ * Bounds the bytes waiting to reach the disk (times the pool buffer size).
+ */
+#define MPD_WRITER_RING_SIZE 64
+
+/**
+ * @brief Creates an idle writer. Nothing happens until a target file is opened.
+ *
+ * @param[in] mbpBuffers  pool the written buffers go back to
+ */
+MPDDiskWriter::MPDDiskWriter(MPDBufferPool *mbpBuffers) {
+    bUring=false;
+    mwrRing=new MPDWriteRequest[MPD_WRITER_RING_SIZE];
+    aui32Head.storeRelaxed(0);
+    aui32Tail.storeRelaxed(0);
+    aui64Written.storeRelaxed(0);
+    aui64Queued.storeRelaxed(0);
+    aiFailed.storeRelaxed(0);
+    aiStopping.storeRelaxed(0);
+    aiProducerWaiting.storeRelaxed(0);
+    aiWriterWaiting.storeRelaxed(0);
+    sLastError.clear();
+    mbpPool=mbpBuffers;
+}
+
+MPDDiskWriter::~MPDDiskWriter() {
+    this->close();
+    delete[] mwrRing;
+}
+
+/**
+ * @brief Stops the writer thread, once every queued write is done, and closes the target file.
+ */
+void MPDDiskWriter::close() {
+    if(this->isRunning()) {
+        // The writer only stops once the ring is empty.
+        aiStopping.storeRelease(1);
+        {
+            QMutexLocker mtlRing(&mtxRing);
+            wcUsed.wakeAll();
+        }
+        this->wait();
+    }
+#if defined(Q_OS_LINUX)&&defined(MPD_HAVE_IO_URING)
+    if(bUring)
+        io_uring_queue_exit(&iorRing);
+#endif
+    bUring=false;
+    fTarget.close();
+}
+
+/**
+ * @brief Waits until every queued write reaches the target file (or the writer fails).
+ *
+ * @return true if every write succeeded
+ */
+bool MPDDiskWriter::flush() {
+    QMutexLocker mtlFlush(&mtxFlush);
+    while(!aiFailed.loadAcquire()&&aui64Written.loadAcquire()<aui64Queued.loadRelaxed())
+        wcFlushed.wait(&mtxFlush);
+    return !aiFailed.loadAcquire();
+}
+
+QString MPDDiskWriter::getLastError() {
+    QMutexLocker mtlFlush(&mtxFlush);
+    return sLastError;
+}
+
+/**
+ * @brief Tells whether a write has failed. Nothing else is written after that.
+ *
+ * @return true if a write failed
+ */
+bool MPDDiskWriter::hasFailed() {
+    return aiFailed.loadAcquire();
+}
+
+/**
+ * @brief Opens the (already existing) target file, without truncating it, and starts the writer thread.
+ *
+ * @param[in] sTargetFile  target filepath
+ *
+ * @return true if the file was opened
+ */
+bool MPDDiskWriter::open(QString sTargetFile) {
+    fTarget.setFileName(sTargetFile);
+    // Unbuffered, since every write goes to its own offset anyway.
+    if(!fTarget.open(QFile::OpenModeFlag::ReadWrite|QFile::OpenModeFlag::Unbuffered)) {
+        sLastError=fTarget.errorString();
+        return false;
+    }
+#if defined(Q_OS_LINUX)&&defined(MPD_HAVE_IO_URING)
+    // Older kernels (or seccomp filters) reject io_uring: writes fall back to pwrite().
+    bUring=0==io_uring_queue_init(MPD_WRITER_RING_SIZE,&iorRing,0);
+#endif
+    this->start();
+    return true;
+}
+
+/**
+ * @brief Queues a write of a buffer taken from the pool, at a given offset of the target file.
+ *
+ * Only waits when the ring is full (which holds the network back until the disk catches up).
+ * Otherwise, no lock is taken: the writer is only woken up (through the mutex) when it
+ * went to sleep.
+ *
+ * @param[in] abtBuffer   the buffer (which goes back to the pool once written)
+ * @param[in] ui64Offset  offset of the target file
+ * @param[in] iLength     bytes of the buffer to write
+ *
+ * @return true if the write was queued (false if a previous one has failed)
+ */
+bool MPDDiskWriter::write(QByteArray abtBuffer,
+                          quint64    ui64Offset,
+                          int        iLength) {
+    quint32 ui32Head;
+    if(aiFailed.loadAcquire()) {
+        mbpPool->trackInFlight(-iLength);
+        mbpPool->release(abtBuffer);
+        return false;
+    }
+    ui32Head=aui32Head.loadRelaxed();
+    if(MPD_WRITER_RING_SIZE<=ui32Head-aui32Tail.loadAcquire()) {
+        QMutexLocker mtlRing(&mtxRing);
+        aiProducerWaiting.fetchAndStoreOrdered(1);
+        // Read-modify-writes (here and in run()) always see each other's latest value, ...
+        // ... so either the writer sees the flag, or this sees the freed slot.
+        while(MPD_WRITER_RING_SIZE<=ui32Head-aui32Tail.fetchAndAddOrdered(0))
+            wcFree.wait(&mtxRing);
+        aiProducerWaiting.storeRelaxed(0);
+    }
+    MPDWriteRequest &mwrSlot=mwrRing[ui32Head%MPD_WRITER_RING_SIZE];
+    mwrSlot.abtBuffer=std::move(abtBuffer);
+    mwrSlot.ui64Offset=ui64Offset;
+    mwrSlot.iLength=iLength;
+    // Only the producer (which is also the one flushing) adds to it.
+    aui64Queued.fetchAndAddRelaxed(iLength);
+    // Publishes the slot, then wakes the writer up (only if it's sleeping).
+    aui32Head.fetchAndAddOrdered(1);
+    if(aiWriterWaiting.fetchAndAddOrdered(0)) {
+        QMutexLocker mtlRing(&mtxRing);
+        wcUsed.wakeOne();
+    }
+    return true;
+}
+
+/**
+ * @brief Preallocates the whole target file, so the writes at scattered offsets do not fragment it.
+ *
+ * Resizing only sets the file size (which may leave it sparse): where possible, the
+ * blocks are reserved too. Filesystems not supporting it just keep the resized file.
+ *
+ * @param[in] fFile     the file (already open)
+ * @param[in] ui64Size  the final file size
+ *
+ * @return true if the file has the given size
+ */
+bool MPDDiskWriter::preallocate(QFile   *fFile,
+                                quint64 ui64Size) {
+    if(!fFile->resize(ui64Size))
+        return false;
+#if defined(Q_OS_LINUX)
+    if(ui64Size)
+        if(int iError=posix_fallocate(fFile->handle(),0,ui64Size))
+            qDebug() << "Unable to preallocate" << fFile->fileName()
+                     << "Error:" << qt_error_string(iError);
+#endif
+    return true;
+}
+
+/**
+ * @brief Records the first failure, and wakes up whoever is flushing.
+ *
+ * @param[in] sError  the error
+ */
+void MPDDiskWriter::fail(QString sError) {
+    QMutexLocker mtlFlush(&mtxFlush);
+    if(!aiFailed.loadAcquire()) {
+        sLastError=sError;
+        aiFailed.storeRelease(1);
+    }
+    wcFlushed.wakeAll();
+}
+
+/**
+ * @brief Writes some bytes at a given offset of the target file, from the writer thread.
+ *
+ * @param[in] lpData      the bytes
+ * @param[in] i64Length   number of bytes
+ * @param[in] ui64Offset  offset of the target file
+ *
+ * @return true if every byte was written
+ */
+bool MPDDiskWriter::writeAt(const char *lpData,
+                            qint64     i64Length,
+                            quint64    ui64Offset) {
+#if defined(Q_OS_UNIX)
+    // The file position is not shared with anybody else, so there's no seeking around.
+    while(i64Length) {
+        ssize_t iWritten=pwrite(fTarget.handle(),lpData,i64Length,ui64Offset);
+        if(0>iWritten) {
+            if(EINTR==errno)
+                continue;
+            this->fail(qt_error_string(errno));
+            return false;
+        }
+        lpData+=iWritten;
+        i64Length-=iWritten;
+        ui64Offset+=iWritten;
+    }
+    return true;
+#else
+    if(!fTarget.seek(ui64Offset)||i64Length!=fTarget.write(lpData,i64Length)) {
+        this->fail(fTarget.errorString());
+        return false;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Writes the next requests of the ring, submitting them all at once when io_uring is available.
+ *
+ * @param[in] iCount  number of requests
+ *
+ * @return true if every request was written
+ */
+bool MPDDiskWriter::writeBatch(int iCount) {
+    quint32 ui32Tail=aui32Tail.loadRelaxed();
+#if defined(Q_OS_LINUX)&&defined(MPD_HAVE_IO_URING)
+    if(bUring) {
+        int iSubmitted=0,iResult;
+        for(int iK=0;iK<iCount;iK++) {
+            const MPDWriteRequest &mwrSlot=mwrRing[(ui32Tail+iK)%MPD_WRITER_RING_SIZE];
+            struct io_uring_sqe   *iosEntry=io_uring_get_sqe(&iorRing);
+            if(nullptr==iosEntry)
+                break;
+            io_uring_prep_write(
+                iosEntry,
+                fTarget.handle(),
+                mwrSlot.abtBuffer.constData(),
+                mwrSlot.iLength,
+                mwrSlot.ui64Offset
+            );
+            io_uring_sqe_set_data(iosEntry,(void *)(quintptr)iK);
+            iSubmitted++;
+        }
+        do
+            iResult=io_uring_submit_and_wait(&iorRing,iSubmitted);
+        while(-EINTR==iResult);
+        if(0>iResult) {
+            this->fail(qt_error_string(-iResult));
+            return false;
+        }
+        // Every completion is reaped, even after a failure, so the ring is left empty.
+        for(int iK=0;iK<iSubmitted;iK++) {
+            struct io_uring_cqe *iocResult;
+            if(0>io_uring_wait_cqe(&iorRing,&iocResult)) {
+                this->fail(QStringLiteral("Unable to complete a write"));
+                return false;
+            }
+            const MPDWriteRequest &mwrSlot=mwrRing[
+                (ui32Tail+(quintptr)io_uring_cqe_get_data(iocResult))%MPD_WRITER_RING_SIZE
+            ];
+            iResult=iocResult->res;
+            io_uring_cqe_seen(&iorRing,iocResult);
+            if(0>iResult)
+                this->fail(qt_error_string(-iResult));
+            // Short writes are completed synchronously.
+            else if(iResult<mwrSlot.iLength&&!aiFailed.loadAcquire())
+                this->writeAt(
+                    mwrSlot.abtBuffer.constData()+iResult,
+                    mwrSlot.iLength-iResult,
+                    mwrSlot.ui64Offset+iResult
+                );
+        }
+        // Whatever did not fit in the submission queue is written synchronously.
+        for(int iK=iSubmitted;iK<iCount&&!aiFailed.loadAcquire();iK++) {
+            const MPDWriteRequest &mwrSlot=mwrRing[(ui32Tail+iK)%MPD_WRITER_RING_SIZE];
+            this->writeAt(mwrSlot.abtBuffer.constData(),mwrSlot.iLength,mwrSlot.ui64Offset);
+        }
+        return !aiFailed.loadAcquire();
+    }
+#endif
+    for(int iK=0;iK<iCount;iK++) {
+        const MPDWriteRequest &mwrSlot=mwrRing[(ui32Tail+iK)%MPD_WRITER_RING_SIZE];
+        if(!this->writeAt(mwrSlot.abtBuffer.constData(),mwrSlot.iLength,mwrSlot.ui64Offset))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the queued requests, as many at once as there are in the ring, until it's closed.
+ *
+ * After a failure, the requests are still taken (and their buffers released), but not written.
+ */
+void MPDDiskWriter::run() {
+    forever {
+        int     iCount;
+        quint32 ui32Tail;
+        quint64 ui64Bytes=0;
+        ui32Tail=aui32Tail.loadRelaxed();
+        iCount=aui32Head.loadAcquire()-ui32Tail;
+        if(!iCount) {
+            QMutexLocker mtlRing(&mtxRing);
+            aiWriterWaiting.fetchAndStoreOrdered(1);
+            // Same handshake as in write(), the other way around.
+            while(!(iCount=aui32Head.fetchAndAddOrdered(0)-ui32Tail)&&!aiStopping.loadAcquire())
+                wcUsed.wait(&mtxRing);
+            aiWriterWaiting.storeRelaxed(0);
+            // Woken up with nothing to write: the writer is being closed.
+            if(!iCount)
+                break;
+        }
+        if(!aiFailed.loadAcquire())
+            this->writeBatch(iCount);
+        for(int iK=0;iK<iCount;iK++) {
+            MPDWriteRequest &mwrSlot=mwrRing[(ui32Tail+iK)%MPD_WRITER_RING_SIZE];
+            ui64Bytes+=mwrSlot.iLength;
+            mbpPool->trackInFlight(-mwrSlot.iLength);
+            mbpPool->release(mwrSlot.abtBuffer);
+        }
+        aui32Tail.fetchAndAddOrdered(iCount);
+        if(aiProducerWaiting.fetchAndAddOrdered(0)) {
+            QMutexLocker mtlRing(&mtxRing);
+            wcFree.wakeOne();
+        }
+        {
+            QMutexLocker mtlFlush(&mtxFlush);
+            aui64Written.fetchAndAddRelease(ui64Bytes);
+            wcFlushed.wakeAll();
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MPDDISKWRITER_H
+#define MPDDISKWRITER_H
+
+#include <QtCore>
+#include "mpdbufferpool.h"
+
+#if defined(Q_OS_LINUX)&&defined(MPD_HAVE_IO_URING)
+#include <liburing.h>
+#endif
+
+/**
+ * @brief A single positional write, waiting in the ring.
+ *
+ * The buffer belongs to the writer until it's written, then it goes back to the pool.
+ */
+typedef struct {
+    QByteArray abtBuffer;
+    quint64    ui64Offset;
+    int        iLength;
+} MPDWriteRequest;
+
+/**
+ * @brief The MPDDiskWriter class
+ *
+ * Moves the disk writes of a download away from the network thread. The bytes are
+ * handed over through a single-producer/single-consumer ring, which is lock-free
+ * as long as it's neither full nor empty: both sides only touch the atomic indexes.
+ * A side finding nothing to do sleeps on a wait condition, after raising a flag the
+ * other side checks (with no lock) once it makes progress. The writer thread issues
+ * positional writes to its own handle of the target file: batched through io_uring
+ * when it's available (Linux, with MPD_HAVE_IO_URING), and one pwrite() at a time
+ * otherwise.
+ * The first failed write stops the writer, and it's reported to the producer.
+ */
+class MPDDiskWriter:public QThread {
+    Q_OBJECT
+private:
+    bool                    bUring;
+    MPDWriteRequest         *mwrRing;
+    QAtomicInteger<quint32> aui32Head;
+    QAtomicInteger<quint32> aui32Tail;
+    QAtomicInteger<quint64> aui64Written;
+    QAtomicInteger<quint64> aui64Queued;
+    QAtomicInteger<int>     aiFailed;
+    QAtomicInteger<int>     aiStopping;
+    QAtomicInteger<int>     aiProducerWaiting;
+    QAtomicInteger<int>     aiWriterWaiting;
+    QString                 sLastError;
+    QMutex                  mtxRing;
+    QWaitCondition          wcFree;
+    QWaitCondition          wcUsed;
+    QMutex                  mtxFlush;
+    QWaitCondition          wcFlushed;
+    QFile                   fTarget;
+    MPDBufferPool           *mbpPool;
+#if defined(Q_OS_LINUX)&&defined(MPD_HAVE_IO_URING)
+    struct io_uring         iorRing;
+#endif
+    void fail(QString);
+    bool writeAt(const char *,qint64,quint64);
+    bool writeBatch(int);
+protected:
+    void run() override;
+public:
+    MPDDiskWriter(MPDBufferPool *);
+    ~MPDDiskWriter();
+    void        close();
+    bool        flush();
+    QString     getLastError();
+    bool        hasFailed();
+    bool        open(QString);
+    bool        write(QByteArray,quint64,int);
+    static bool preallocate(QFile *,quint64);
+};
+
+#endif // MPDDISKWRITER_H
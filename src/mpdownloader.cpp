@@ -26,36 +26,1758 @@
 #define MPD_HEADER_USER_AGENT_DEFAULT "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/101.0.4951.67 Safari/537.36"
 
 /**
- * @brief Maximum number of parts a download can be splitted into.
+ * @brief Default maximum number of parts (connections) downloading chunks at the same time.
  */
 #define MPD_MAX_DOWNLOAD_PARTS 16
 
 /**
- * @brief Minimum allowed part size (in bytes) a download can be splitted into.
+ * @brief Maximum number of HTTP/1.1 connections per host, a single QNetworkAccessManager opens.
  */
-#define MPD_MIN_DOWNLOAD_PART_SIZE 1048576
+#define MPD_CONNECTIONS_PER_MANAGER 6
+
+/**
+ * @brief Default chunk size (in bytes) a download is splitted into, until a better one is known.
+ */
+#define MPD_DEFAULT_CHUNK_SIZE 2097152
+
+/**
+ * @brief Minimum chunk size (in bytes) the auto-tuning can choose.
+ */
+#define MPD_MIN_CHUNK_SIZE 262144
+
+/**
+ * @brief Maximum chunk size (in bytes) a download can be splitted into.
+ */
+#define MPD_MAX_CHUNK_SIZE 16777216
+
+/**
+ * @brief Maximum amount of bytes (per part) buffered in memory, when downloading to a file.
+ */
+#define MPD_PART_BUFFER_SIZE 262144
+
+/**
+ * @brief Default time (in milliseconds) a part can go without receiving bytes, before it's restarted.
+ */
+#define MPD_DEFAULT_STALL_TIMEOUT 15000
+
+/**
+ * @brief Default maximum number of parts duplicating the last outstanding chunks.
+ */
+#define MPD_DEFAULT_HEDGED_PARTS 2
+
+/**
+ * @brief Interval (in milliseconds) between consecutive checks for stalled parts.
+ */
+#define MPD_WATCHDOG_INTERVAL 1000
+
+/**
+ * @brief Default maximum number of retries for a chunk failing for transient reasons.
+ */
+#define MPD_DEFAULT_MAX_RETRIES 5
+
+/**
+ * @brief Delay (in milliseconds) before the first retry of a chunk. It doubles on every retry.
+ */
+#define MPD_RETRY_BASE_DELAY 500
+
+/**
+ * @brief Maximum delay (in milliseconds) before retrying a chunk.
+ */
+#define MPD_RETRY_MAX_DELAY 30000
+
+/**
+ * @brief Maximum number of times the URL of a single download can be refreshed.
+ */
+#define MPD_MAX_URL_REFRESHES 3
+
+/**
+ * @brief Delay (in milliseconds) before trying again a URL refresh which found another one running.
+ */
+#define MPD_REFRESH_RETRY_DELAY 100
+
+/**
+ * @brief Suffix appended to the target file name, to get the resume journal file name.
+ */
+#define MPD_JOURNAL_SUFFIX ".journal"
+
+/**
+ * @brief Hash algorithm the chunks are checksummed with, as their bytes arrive.
+ *
+ * It only has to catch corruption (not tampering), so a fast one is enough.
+ */
+#define MPD_CHUNK_HASH_ALGORITHM QCryptographicHash::Algorithm::Md5
+
+/**
+ * @brief Minimum amount of bytes (per part) buffered in memory, when the bandwidth is capped.
+ */
+#define MPD_MIN_PART_BUFFER_SIZE 16384
+
+/**
+ * @brief Size (in bytes) of every pooled buffer the replies are drained into.
+ */
+#define MPD_POOL_BUFFER_SIZE 65536
+
+/**
+ * @brief Maximum number of free buffers kept in the pool, for reuse.
+ */
+#define MPD_POOL_MAX_FREE_BUFFERS 32
+
+/**
+ * @brief Default interval (in milliseconds) between consecutive progress reports.
+ */
+#define MPD_DEFAULT_PROGRESS_INTERVAL 100
+
+/**
+ * @brief Weight of the latest throughput sample in the smoothed rate the ETA is based on.
+ */
+#define MPD_PROGRESS_EWMA_ALPHA 0.2
+
+/**
+ * @brief Initial number of parts of an auto-tuned download, for a host never seen before.
+ */
+#define MPD_TUNE_INITIAL_PARTS 4
+
+/**
+ * @brief Interval (in milliseconds) between consecutive auto-tuning steps.
+ */
+#define MPD_TUNE_INTERVAL 1000
+
+/**
+ * @brief Relative throughput gain which makes the auto-tuning add another part.
+ */
+#define MPD_TUNE_GAIN 0.05
+
+/**
+ * @brief Relative throughput loss which makes the auto-tuning cut the parts down.
+ */
+#define MPD_TUNE_LOSS 0.15
+
+/**
+ * @brief Time (in milliseconds) a single part should take to download an auto-tuned chunk.
+ */
+#define MPD_TUNE_CHUNK_TIME 2000
+
+/**
+ * @brief Minimum ratio between the time spent downloading a chunk and the time to its first byte.
+ */
+#define MPD_TUNE_TTFB_RATIO 10
+
+/**
+ * @brief Weight of the latest sample in the smoothed time-to-first-byte and per-part throughput.
+ */
+#define MPD_TUNE_EWMA_ALPHA 0.25
+
+/**
+ * @brief Settings group keeping the auto-tuned values of every host.
+ */
+#define MPD_TUNE_SETTINGS_GROUP "mpdtuning"
+
+MPDWorker::MPDWorker():mbpPool(MPD_POOL_BUFFER_SIZE,MPD_POOL_MAX_FREE_BUFFERS) {
+    bActive=false;
+    bRanged=false;
+    bInPlace=false;
+    bRefreshing=false;
+    uiSession=0;
+    iRefreshes=0;
+    iResumeTurn=0;
+    iChunksLeft=0;
+    sURL.clear();
+    ui64ContentLength=0;
+    ui64TotalDone=0;
+    aui64Received.storeRelaxed(0);
+    aui64Total.storeRelaxed(0);
+    ui64JournalSize=0;
+    ui64ProbeStart=0;
+    ui64ProbeEnd=0;
+    ui64Job=0;
+    iTargetParts=MPD_MAX_DOWNLOAD_PARTS;
+    ui64ChunkSize=MPD_DEFAULT_CHUNK_SIZE;
+    ui64TuneBytes=0;
+    i64TuneLast=0;
+    i64TuneCut=0;
+    i64ProbeSent=0;
+    dTuneRate=0;
+    dTTFB=0;
+    dPartRate=0;
+    sJournalFile.clear();
+    abtTarget=nullptr;
+    fTarget=nullptr;
+    mdwWriter=nullptr;
+    mstTarget=nullptr;
+    nrpProbe=nullptr;
+    // Being a child, the timer follows the worker to its thread.
+    tmrWatchdog=new QTimer(this);
+    tmrWatchdog->setInterval(MPD_WATCHDOG_INTERVAL);
+    connect(
+        tmrWatchdog,
+        &QTimer::timeout,
+        this,
+        &MPDWorker::watchdogTimeout
+    );
+    tmrTuner=new QTimer(this);
+    tmrTuner->setInterval(MPD_TUNE_INTERVAL);
+    connect(
+        tmrTuner,
+        &QTimer::timeout,
+        this,
+        &MPDWorker::tuneTimeout
+    );
+    tmrThrottle=new QTimer(this);
+    tmrThrottle->setSingleShot(true);
+    connect(
+        tmrThrottle,
+        &QTimer::timeout,
+        this,
+        &MPDWorker::resumeParts
+    );
+    // Queued, since the scheduler can be called from any worker thread (including this one).
+    connect(
+        MPDScheduler::instance(),
+        &MPDScheduler::budgetChanged,
+        this,
+        &MPDWorker::rebalance,
+        Qt::ConnectionType::QueuedConnection
+    );
+    mpsSettings.iMaxParts=MPD_MAX_DOWNLOAD_PARTS;
+    mpsSettings.mptTransport=MPDTransport::MPDT_HTTP1;
+    mpsSettings.iStallTimeout=MPD_DEFAULT_STALL_TIMEOUT;
+    mpsSettings.iHedgedParts=MPD_DEFAULT_HEDGED_PARTS;
+    mpsSettings.iMaxRetries=MPD_DEFAULT_MAX_RETRIES;
+    mpsSettings.mppPriority=MPDPriority::MPDP_NORMAL;
+    mpsSettings.bAutoTune=true;
+    mpsSettings.bVerify=false;
+    mpsSettings.bRefreshURL=false;
+    mpsSettings.ui64RangeStart=0;
+    mpsSettings.ui64RangeEnd=0;
+    iVerifyPasses=0;
+    mmlManagers.clear();
+    mclChunks.clear();
+    queChunks.clear();
+    mpmParts.clear();
+    mrlCompleted.clear();
+}
+
+/**
+ * @brief Releases whatever an unfinished download still holds (the disk writer, the
+ * checksums, the scheduler job, etc), in case the thread stopped before it was canceled.
+ */
+MPDWorker::~MPDWorker() {
+    if(bActive)
+        this->finish(false,QString());
+}
+
+/**
+ * @brief Cancels the active download (if any), without reporting an error.
+ */
+void MPDWorker::cancel() {
+    if(bActive)
+        this->finish(false,QString());
+}
+
+/**
+ * @brief Gets the buffer pool counters.
+ *
+ * Safe to be called from any thread.
+ *
+ * @return the current counters
+ */
+MPDPoolStats MPDWorker::poolStats() {
+    return mbpPool.getStats();
+}
+
+/**
+ * @brief Gets the running progress totals.
+ *
+ * Safe (and cheap) to be called from any thread.
+ *
+ * @param[out] ui64Received  amount of bytes received
+ * @param[out] ui64Total     total bytes to download (0 if unknown)
+ */
+void MPDWorker::progressTotals(quint64 &ui64Received,
+                               quint64 &ui64Total) {
+    ui64Received=aui64Received.loadRelaxed();
+    ui64Total=aui64Total.loadRelaxed();
+}
+
+/**
+ * @brief Continues the download with a refreshed URL, only fetching what's left.
+ *
+ * @param[in] uiForSession  session the refresh was requested for
+ * @param[in] sNewURL       the new URL (an empty string if it could not be refreshed)
+ */
+void MPDWorker::refreshURL(uint    uiForSession,
+                           QString sNewURL) {
+    // The download could have been canceled in the meantime.
+    if(!bActive||!bRefreshing||uiForSession!=uiSession)
+        return;
+    bRefreshing=false;
+    if(sNewURL.isEmpty()) {
+        this->finish(false,QStringLiteral("Unable to refresh the expired URL"));
+        return;
+    }
+    sURL=sNewURL;
+    this->launchParts();
+}
+
+/**
+ * @brief Clears the running progress totals, left by the previous download.
+ *
+ * Safe to be called from any thread.
+ */
+void MPDWorker::resetProgress() {
+    aui64Received.storeRelaxed(0);
+    aui64Total.storeRelaxed(0);
+}
+
+/**
+ * @brief Starts downloading the given resource.
+ *
+ * Only sends the first request. Everything else happens as the replies arrive,
+ * until finished() is emitted.
+ *
+ * @param[in] sSourceURL       URL containing the resource to be downloaded
+ * @param[in] abtMemoryTarget  in-memory target (or nullptr)
+ * @param[in] sTargetFile      path of the target file (or an empty string)
+ * @param[in] mstStream        stream target (or nullptr)
+ * @param[in] mpsDownload      settings for this download
+ */
+void MPDWorker::start(QString     sSourceURL,
+                      QByteArray  *abtMemoryTarget,
+                      QString     sTargetFile,
+                      MPDStream   *mstStream,
+                      MPDSettings mpsDownload) {
+    sURL=sSourceURL;
+    bRanged=false;
+    bInPlace=false;
+    bRefreshing=false;
+    iRefreshes=0;
+    iChunksLeft=0;
+    ui64ContentLength=0;
+    ui64TotalDone=0;
+    this->resetProgress();
+    abtTarget=abtMemoryTarget;
+    mstTarget=mstStream;
+    mpsSettings=mpsDownload;
+    ui64Streamed=mpsSettings.ui64RangeStart;
+    ui64JournalSize=0;
+    ui64ProbeStart=mpsSettings.ui64RangeStart;
+    ui64ProbeEnd=0;
+    ui64TuneBytes=0;
+    i64TuneLast=0;
+    i64TuneCut=-MPD_TUNE_INTERVAL;
+    dTuneRate=0;
+    iVerifyPasses=0;
+    sJournalFile.clear();
+    mclChunks.clear();
+    queChunks.clear();
+    mpmParts.clear();
+    mrlCompleted.clear();
+    etmClock.start();
+    bActive=true;
+    ui64Job=MPDScheduler::instance()->registerJob(
+        mpsSettings.mppPriority,
+        mpsSettings.iMaxParts
+    );
+    this->createManagers();
+    this->loadTuning();
+    // A reader falling behind holds every part back, until it drains the stream.
+    if(nullptr!=mstTarget)
+        connect(
+            mstTarget,
+            &MPDStream::spaceAvailable,
+            this,
+            &MPDWorker::resumeParts,
+            Qt::ConnectionType::QueuedConnection
+        );
+    if(!sTargetFile.isEmpty()) {
+        // The existing contents are kept (not truncated) until it's known ...
+        // ... whether the download can be resumed or not.
+        // Unbuffered, since the writes go through another handle: a read-ahead ...
+        // ... buffer here could keep bytes older than the ones just written.
+        fTarget=new QFile(sTargetFile,this);
+        if(!fTarget->open(QFile::OpenModeFlag::ReadWrite|QFile::OpenModeFlag::Unbuffered)) {
+            this->finish(false,fTarget->errorString());
+            return;
+        }
+        // The writes go through a handle of their own, in the writer thread.
+        mdwWriter=new MPDDiskWriter(&mbpPool);
+        if(!mdwWriter->open(sTargetFile)) {
+            this->finish(false,mdwWriter->getLastError());
+            return;
+        }
+        sJournalFile=sTargetFile+QStringLiteral(MPD_JOURNAL_SUFFIX);
+        this->loadJournal();
+    }
+    // Asks for the first chunk right away (the first missing one, when resuming): ...
+    // ... its response tells whether the server supports the Range header, ...
+    // ... and the resource size, so there's no need for a separate HEAD request.
+    for(const auto &r:qAsConst(mrlCompleted))
+        if(r.ui64Start==ui64ProbeStart)
+            ui64ProbeStart=r.ui64End+1;
+        else
+            break;
+    // A complete journal (which should not be left behind) is validated from the start.
+    if(ui64JournalSize&&ui64ProbeStart>=ui64JournalSize)
+        ui64ProbeStart=0;
+    ui64ProbeEnd=ui64ProbeStart+ui64ChunkSize-1;
+    if(mpsSettings.ui64RangeEnd)
+        ui64ProbeEnd=qMin(ui64ProbeEnd,mpsSettings.ui64RangeEnd);
+    for(const auto &r:qAsConst(mrlCompleted))
+        if(r.ui64Start>ui64ProbeStart) {
+            ui64ProbeEnd=qMin(ui64ProbeEnd,r.ui64Start-1);
+            break;
+        }
+    i64ProbeSent=etmClock.elapsed();
+    nrpProbe=mmlManagers.at(0)->get(
+        this->createRequest(true,ui64ProbeStart,ui64ProbeEnd)
+    );
+    connect(
+        nrpProbe,
+        &QNetworkReply::metaDataChanged,
+        this,
+        &MPDWorker::probeResponded
+    );
+    connect(
+        nrpProbe,
+        &QNetworkReply::finished,
+        this,
+        &MPDWorker::probeFinished
+    );
+}
+
+/**
+ * @brief Creates a request for the current resource.
+ *
+ * @param[in] bWithRange  true if the Range header must be set
+ * @param[in] ui64Start   range start
+ * @param[in] ui64End     range end (inclusive)
+ *
+ * @return the request, ready to be sent
+ */
+QNetworkRequest MPDWorker::createRequest(bool    bWithRange,
+                                         quint64 ui64Start,
+                                         quint64 ui64End) {
+    QNetworkRequest nrqRequest;
+    nrqRequest.setUrl(QUrl(sURL));
+    nrqRequest.setHeader(
+        QNetworkRequest::KnownHeaders::UserAgentHeader,
+        QStringLiteral(MPD_HEADER_USER_AGENT_DEFAULT)
+    );
+    // HTTP/2 must be explicitly disabled, since newer Qt versions allow it by default.
+    nrqRequest.setAttribute(
+        QNetworkRequest::Attribute::Http2AllowedAttribute,
+        MPDTransport::MPDT_HTTP2==mpsSettings.mptTransport
+    );
+    if(bWithRange)
+        // Sets the Range header (if possible) for the associated request.
+        nrqRequest.setRawHeader(
+            QStringLiteral("Range").toUtf8(),
+            QStringLiteral("bytes=%1-%2").arg(ui64Start).arg(ui64End).toUtf8()
+        );
+    return nrqRequest;
+}
+
+/**
+ * @brief Creates the access managers needed to open every part's connection.
+ *
+ * The managers are kept between downloads, so their connections can be reused.
+ * They must live in the worker thread, so they're created here.
+ */
+void MPDWorker::createManagers() {
+    int iNeeded=1;
+    if(MPDTransport::MPDT_HTTP1==mpsSettings.mptTransport)
+        iNeeded=(mpsSettings.iMaxParts+MPD_CONNECTIONS_PER_MANAGER-1)/MPD_CONNECTIONS_PER_MANAGER;
+    while(mmlManagers.count()<iNeeded)
+        mmlManagers.append(new QNetworkAccessManager(this));
+}
+
+/**
+ * @brief Stops a part and forgets about it, keeping whatever it already wrote.
+ *
+ * @param[in] nrpReply  the reply associated to the part
+ */
+void MPDWorker::dropPart(QNetworkReply *nrpReply) {
+    mclChunks[mpmParts.value(nrpReply).iChunk].iParts--;
+    mpmParts.remove(nrpReply);
+    // Disconnects first, since aborting a reply emits its finished() signal.
+    nrpReply->disconnect(this);
+    nrpReply->abort();
+    nrpReply->deleteLater();
+}
+
+/**
+ * @brief Hands the bytes contiguous to the ones already streamed over to the stream target.
+ *
+ * Chunks finishing ahead of the stream keep their bytes until the stream gets to them.
+ * Fully streamed chunks let their bytes go, so only the chunks in progress (and the
+ * ones ahead of them) are kept in memory.
+ */
+void MPDWorker::feedStream() {
+    bool bNext;
+    do {
+        bNext=false;
+        for(auto &c:mclChunks)
+            if(c.ui64Start<=ui64Streamed&&ui64Streamed<=c.ui64End) {
+                quint64 ui64Relative=ui64Streamed-c.ui64Start;
+                if(c.ui64Done>ui64Relative) {
+                    mstTarget->push(c.abtData.mid(ui64Relative,c.ui64Done-ui64Relative));
+                    ui64Streamed=c.ui64Start+c.ui64Done;
+                    // The next chunk could have been finished already.
+                    if(ui64Streamed>c.ui64End) {
+                        if(c.bFinished)
+                            c.abtData.clear();
+                        bNext=true;
+                    }
+                }
+                break;
+            }
+    } while(bNext);
+}
+
+/**
+ * @brief Finishes the active download, releasing every pending reply.
+ *
+ * @param[in] bResult  true if every chunk was downloaded successfully
+ * @param[in] sError   the error which stopped the download (if any)
+ */
+void MPDWorker::finish(bool    bResult,
+                       QString sError) {
+    tmrWatchdog->stop();
+    tmrThrottle->stop();
+    tmrTuner->stop();
+    if(bResult&&bRanged&&mpsSettings.bAutoTune)
+        this->saveTuning();
+    if(nullptr!=nrpProbe) {
+        nrpProbe->disconnect(this);
+        nrpProbe->abort();
+        nrpProbe->deleteLater();
+        nrpProbe=nullptr;
+    }
+    for(auto nrpReply:mpmParts.keys())
+        this->dropPart(nrpReply);
+    // In-place contents are already where they belong: only the size may need adjusting, ...
+    // ... when the server sent less than announced (without ranges, that's the whole resource).
+    if(bInPlace) {
+        if(!bResult)
+            abtTarget->clear();
+        else if(!bRanged)
+            abtTarget->resize(ui64TotalDone);
+    }
+    // Proceeds to join the downloaded contents (in-memory downloads of unknown size), ...
+    // ... in offset order, since the chunks are split (and appended) as they're started.
+    else if(bResult&&nullptr!=abtTarget) {
+        std::sort(
+            mclChunks.begin(),
+            mclChunks.end(),
+            [](const MPDChunk &c1,const MPDChunk &c2) {
+                return c1.ui64Start<c2.ui64Start;
+            }
+        );
+        for(auto &c:mclChunks) {
+            abtTarget->append(c.abtData);
+            c.abtData.clear();
+        }
+    }
+    mclChunks.clear();
+    queChunks.clear();
+    qDeleteAll(mhmHashes);
+    mhmHashes.clear();
+    // Nothing is finished until every byte is on the disk.
+    if(nullptr!=mdwWriter) {
+        if(bResult&&!mdwWriter->flush()) {
+            bResult=false;
+            sError=mdwWriter->getLastError();
+        }
+        mdwWriter->close();
+        delete mdwWriter;
+        mdwWriter=nullptr;
+    }
+    if(nullptr!=fTarget) {
+        fTarget->close();
+        // Incomplete contents are kept for resuming later, unless there's nothing to resume.
+        if(bResult)
+            QFile::remove(sJournalFile);
+        else
+            if(mrlCompleted.isEmpty()) {
+                fTarget->remove();
+                QFile::remove(sJournalFile);
+            }
+        delete fTarget;
+        fTarget=nullptr;
+    }
+    mrlCompleted.clear();
+    abtTarget=nullptr;
+    bInPlace=false;
+    // The reader still gets whatever was handed over, before seeing the end.
+    if(nullptr!=mstTarget) {
+        mstTarget->disconnect(this);
+        mstTarget->close(bResult,sError);
+        mstTarget=nullptr;
+    }
+    bRefreshing=false;
+    bActive=false;
+    // Gives the connections back, so other downloads can use them.
+    MPDScheduler::instance()->unregisterJob(ui64Job);
+    ui64Job=0;
+    // Pending retries belong to this session, so they must not touch the next one.
+    uiSession++;
+    emit finished(bResult,sError);
+}
+
+/**
+ * @brief Tells whether a failed request is worth retrying.
+ *
+ * Server overload (5xx, 429, 408), connection resets and timeouts are considered transient.
+ * Any other HTTP response (403, 404, etc) is considered fatal, and so is an unknown host
+ * or a refused connection, which no backoff is going to fix.
+ *
+ * @param[in] uiResCode  HTTP response code (0 if there was no response)
+ * @param[in] nreError   network error reported by the reply
+ *
+ * @return true if the request should be retried
+ */
+bool MPDWorker::isTransientFailure(uint                        uiResCode,
+                                   QNetworkReply::NetworkError nreError) {
+    bool bResult=false;
+    // A connection reset in the middle of the body still carries a successful code.
+    if(400<=uiResCode)
+        bResult=500<=uiResCode||429==uiResCode||408==uiResCode;
+    else
+        switch(nreError) {
+            case QNetworkReply::NetworkError::RemoteHostClosedError:
+            case QNetworkReply::NetworkError::TimeoutError:
+            case QNetworkReply::NetworkError::ProxyConnectionClosedError:
+            case QNetworkReply::NetworkError::ProxyTimeoutError:
+                bResult=true;
+                break;
+            default:
+                bResult=false;
+        }
+    return bResult;
+}
+
+/**
+ * @brief Takes a reply (already sent) as a new part for the given chunk.
+ *
+ * @param[in] nrpReply    the reply, which must be receiving the chunk from the point it was left
+ * @param[in] iChunk      index of the chunk
+ * @param[in] iManager    index of the access manager which sent the request
+ * @param[in] i64Launched time the request was sent at
+ */
+void MPDWorker::attachPart(QNetworkReply *nrpReply,
+                           int           iChunk,
+                           int           iManager,
+                           qint64        i64Launched) {
+    quint64  ui64BandwidthCap;
+    MPDPart  mppPart;
+    MPDChunk &mpcChunk=mclChunks[iChunk];
+    mppPart.iChunk=iChunk;
+    mppPart.iManager=iManager;
+    mppPart.ui64Start=mpcChunk.ui64Start+mpcChunk.ui64Done;
+    mppPart.ui64Written=0;
+    mppPart.i64LastActivity=etmClock.elapsed();
+    mppPart.i64Launched=i64Launched;
+    mppPart.i64FirstByte=-1;
+    mpcChunk.iParts++;
+    mpmParts.insert(nrpReply,mppPart);
+    // Keeps the reply's internal buffer small: the bytes are moved to ...
+    // ... the target every time there's something to read. Once it's full, ...
+    // ... Qt stops reading from the socket, which is what holds a throttled part.
+    ui64BandwidthCap=MPDScheduler::instance()->getBandwidthCap();
+    if(ui64BandwidthCap)
+        nrpReply->setReadBufferSize(
+            qBound<quint64>(MPD_MIN_PART_BUFFER_SIZE,ui64BandwidthCap/10,MPD_PART_BUFFER_SIZE)
+        );
+    else
+        nrpReply->setReadBufferSize(MPD_PART_BUFFER_SIZE);
+    // Every signal is bound to its own reply, since it's not expected ...
+    // ... the replies to be triggered in order.
+    connect(
+        nrpReply,
+        &QNetworkReply::readyRead,
+        this,
+        [this,nrpReply]() {
+            this->writePart(nrpReply);
+        }
+    );
+    connect(
+        nrpReply,
+        &QNetworkReply::finished,
+        this,
+        [this,nrpReply]() {
+            this->partFinished(nrpReply);
+        }
+    );
+}
+
+/**
+ * @brief Starts a new part for the given chunk.
+ *
+ * The part resumes the chunk from the point it was left (if that's the case).
+ *
+ * @param[in] iChunk  index of the chunk
+ */
+void MPDWorker::launchPart(int iChunk) {
+    int      iManager=0;
+    MPDChunk &mpcChunk=mclChunks[iChunk];
+    // Without ranges, there's no way to resume: the chunk starts all over again.
+    if(!bRanged&&mpcChunk.ui64Done) {
+        ui64TotalDone-=mpcChunk.ui64Done;
+        aui64Received.storeRelaxed(ui64TotalDone);
+        mpcChunk.ui64Done=0;
+        mpcChunk.abtData.clear();
+    }
+    // Picks the manager with the fewest parts, which is the one with spare connections.
+    if(MPDTransport::MPDT_HTTP1==mpsSettings.mptTransport) {
+        QVector<int> viLoad(mmlManagers.count(),0);
+        for(const auto &p:qAsConst(mpmParts))
+            viLoad[p.iManager]++;
+        for(int iK=1;iK<viLoad.count();iK++)
+            if(viLoad.at(iK)<viLoad.at(iManager))
+                iManager=iK;
+    }
+    this->attachPart(
+        mmlManagers.at(iManager)->get(
+            this->createRequest(
+                bRanged,
+                mpcChunk.ui64Start+mpcChunk.ui64Done,
+                mpcChunk.ui64End
+            )
+        ),
+        iChunk,
+        iManager,
+        etmClock.elapsed()
+    );
+}
+
+/**
+ * @brief Starts a new part for every queued chunk, until all the granted connections are busy.
+ *
+ * Once the queue is empty, the spare connections are used to hedge the outstanding
+ * chunks with the most bytes left. The download finishes once there's nothing left
+ * to queue nor to wait for.
+ */
+void MPDWorker::launchParts() {
+    int iAllowed;
+    // Nothing new is started until there's a valid URL again.
+    if(bRefreshing)
+        return;
+    // Tells the scheduler how many connections are still useful, before asking for them.
+    // Queued chunks can still be split, so they could use every connection.
+    MPDScheduler::instance()->setJobDemand(
+        ui64Job,
+        queChunks.isEmpty()?
+            qMin(this->partLimit(),iChunksLeft+(bRanged?mpsSettings.iHedgedParts:0)):
+            this->partLimit()
+    );
+    iAllowed=qMin(this->partLimit(),MPDScheduler::instance()->jobConnections(ui64Job));
+    while(iAllowed>mpmParts.count()&&!queChunks.isEmpty()) {
+        int iChunk=queChunks.dequeue(),iRest;
+        // Fresh chunks are cut down to the current chunk size, right before starting.
+        if(bRanged&&!mclChunks.at(iChunk).ui64Done)
+            if(-1!=(iRest=this->splitChunk(iChunk,ui64ChunkSize)))
+                queChunks.prepend(iRest);
+        this->launchPart(iChunk);
+    }
+    if(bRanged&&queChunks.isEmpty()) {
+        int iHedged=0;
+        for(const auto &c:qAsConst(mclChunks))
+            if(!c.bFinished&&1<c.iParts)
+                iHedged++;
+        while(iAllowed>mpmParts.count()&&mpsSettings.iHedgedParts>iHedged) {
+            int     iCandidate=-1;
+            quint64 ui64Left,ui64MaxLeft=MPD_PART_BUFFER_SIZE;
+            // Only chunks with a single part and enough bytes left are worth hedging.
+            for(int iK=0;iK<mclChunks.count();iK++)
+                if(!mclChunks.at(iK).bFinished&&1==mclChunks.at(iK).iParts) {
+                    ui64Left=mclChunks.at(iK).ui64End+1-
+                             mclChunks.at(iK).ui64Start-mclChunks.at(iK).ui64Done;
+                    if(ui64Left>ui64MaxLeft) {
+                        ui64MaxLeft=ui64Left;
+                        iCandidate=iK;
+                    }
+                }
+            if(-1==iCandidate)
+                break;
+            this->launchPart(iCandidate);
+            iHedged++;
+        }
+    }
+    // Once all chunks are complete (and verified, if requested), we have a success.
+    if(!iChunksLeft)
+        if(this->verifyDownload())
+            this->finish(true,QString());
+}
+
+/**
+ * @brief Loads the resume journal of the target file, if there's one.
+ *
+ * The completed ranges are only taken when the journal belongs to the same resource,
+ * which is identified by the resume key (or by the URL, when there's no key).
+ * They are validated against the actual resource later, once its size is known,
+ * and against their checksums (when the journal has them).
+ */
+void MPDWorker::loadJournal() {
+    QFile         fJournal(sJournalFile);
+    QJsonDocument jsnDoc;
+    QJsonObject   jsnObj;
+    QString       sKey=mpsSettings.sResumeKey.isEmpty()?sURL:mpsSettings.sResumeKey;
+    ui64JournalSize=0;
+    mrlCompleted.clear();
+    if(fJournal.open(QFile::OpenModeFlag::ReadOnly)) {
+        jsnDoc=QJsonDocument::fromJson(fJournal.readAll());
+        fJournal.close();
+        if(jsnDoc.isObject()) {
+            jsnObj=jsnDoc.object();
+            if(sKey==jsnObj.value(QStringLiteral("key")).toString()) {
+                ui64JournalSize=(quint64)jsnObj.value(QStringLiteral("size")).toDouble();
+                for(const auto &v:jsnObj.value(QStringLiteral("ranges")).toArray()) {
+                    QJsonArray jsnRange=v.toArray();
+                    MPDRange   mprRange;
+                    // Older journals have no checksums: their ranges are taken as they are.
+                    if(2!=jsnRange.count()&&3!=jsnRange.count())
+                        continue;
+                    mprRange.ui64Start=(quint64)jsnRange.at(0).toDouble();
+                    mprRange.ui64End=(quint64)jsnRange.at(1).toDouble();
+                    mprRange.abtDigest=QByteArray::fromHex(jsnRange.at(2).toString().toLatin1());
+                    // Discards anything not making sense for the declared size.
+                    if(mprRange.ui64Start<=mprRange.ui64End&&mprRange.ui64End<ui64JournalSize)
+                        mrlCompleted.append(mprRange);
+                }
+                std::sort(
+                    mrlCompleted.begin(),
+                    mrlCompleted.end(),
+                    [](const MPDRange &a,const MPDRange &b) {
+                        return a.ui64Start<b.ui64Start;
+                    }
+                );
+                // Overlapping ranges would break the missing ranges calculation.
+                for(int iK=1;iK<mrlCompleted.count();)
+                    if(mrlCompleted.at(iK).ui64Start<=mrlCompleted.at(iK-1).ui64End)
+                        mrlCompleted.removeAt(iK);
+                    else
+                        iK++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Loads the auto-tuned values for the current host, if there are any.
+ *
+ * Otherwise (or when the auto-tuning is disabled), starts from the defaults.
+ */
+void MPDWorker::loadTuning() {
+    QSettings stnTuning(
+        QSettings::Format::IniFormat,
+        QSettings::Scope::UserScope,
+        QStringLiteral("yay"),
+        QStringLiteral(MPD_TUNE_SETTINGS_GROUP)
+    );
+    QString   sHost=QUrl(sURL).host();
+    iTargetParts=mpsSettings.iMaxParts;
+    ui64ChunkSize=MPD_DEFAULT_CHUNK_SIZE;
+    dTTFB=0;
+    dPartRate=0;
+    if(mpsSettings.bAutoTune&&!sHost.isEmpty()) {
+        stnTuning.beginGroup(sHost);
+        iTargetParts=qBound(
+            1,
+            stnTuning.value(QStringLiteral("parts"),MPD_TUNE_INITIAL_PARTS).toInt(),
+            mpsSettings.iMaxParts
+        );
+        ui64ChunkSize=qBound<quint64>(
+            MPD_MIN_CHUNK_SIZE,
+            stnTuning.value(QStringLiteral("chunksize"),MPD_DEFAULT_CHUNK_SIZE).toULongLong(),
+            MPD_MAX_CHUNK_SIZE
+        );
+        stnTuning.endGroup();
+    }
+}
+
+/**
+ * @brief Handles the end (for good or bad) of a single part.
+ *
+ * A successful part completes its chunk (stopping any other part working on it),
+ * and frees its connection for the next one. A failing part only fails the
+ * download when no other part is working on the same chunk.
+ *
+ * @param[in] nrpReply  the reply associated to the part
+ */
+void MPDWorker::partFinished(QNetworkReply *nrpReply) {
+    bool    bTransient=false;
+    uint    uiResCode;
+    int     iChunk=mpmParts.value(nrpReply).iChunk;
+    MPDPart mppPart;
+    QString sError;
+    uiResCode=nrpReply->attribute(
+        QNetworkRequest::Attribute::HttpStatusCodeAttribute
+    ).toUInt();
+    if(QNetworkReply::NetworkError::NoError!=nrpReply->error()) {
+        sError=nrpReply->errorString();
+        bTransient=this->isTransientFailure(uiResCode,nrpReply->error());
+    }
+    // A ranged request must get a partial response. Otherwise, the whole resource is coming.
+    else if(!(206==uiResCode||(!bRanged&&200==uiResCode))) {
+        sError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
+        bTransient=this->isTransientFailure(uiResCode,nrpReply->error());
+    }
+    // Collects whatever is left in the reply's buffer (even if over the bandwidth cap).
+    else if(!this->writePart(nrpReply,true))
+        return;
+    mppPart=mpmParts.value(nrpReply);
+    this->dropPart(nrpReply);
+    MPDChunk &mpcChunk=mclChunks[iChunk];
+    if(sError.isEmpty()) {
+        // Without a known content length, whatever was received is the whole resource.
+        if(!bRanged)
+            mpcChunk.ui64End=mpcChunk.ui64Done-1;
+        if(mpcChunk.ui64Start+mpcChunk.ui64Done==mpcChunk.ui64End+1) {
+            this->sampleRate(mppPart);
+            if(mhmHashes.contains(iChunk)) {
+                QCryptographicHash *crhChunk=mhmHashes.take(iChunk);
+                mpcChunk.abtDigest=crhChunk->result();
+                delete crhChunk;
+            }
+            mpcChunk.bFinished=true;
+            iChunksLeft--;
+            // Already streamed, so the bytes are no longer needed.
+            if(nullptr!=mstTarget&&ui64Streamed>mpcChunk.ui64End)
+                mpcChunk.abtData.clear();
+            this->recordChunk(iChunk);
+            // Keeps the winner, stopping the hedged parts working on the same chunk.
+            for(auto nrpOther:mpmParts.keys())
+                if(iChunk==mpmParts.value(nrpOther).iChunk)
+                    this->dropPart(nrpOther);
+        }
+        else {
+            // The connection was closed too early, which is worth another try.
+            sError=QStringLiteral("Incomplete chunk: %1-%2").
+                   arg(mpcChunk.ui64Start).
+                   arg(mpcChunk.ui64End);
+            bTransient=true;
+        }
+    }
+    // An expired URL is refreshed (if possible), and the chunk continues from where it was left.
+    if(!sError.isEmpty()&&bRanged&&mpsSettings.bRefreshURL&&(403==uiResCode||410==uiResCode)) {
+        if(!mpcChunk.bFinished&&!mpcChunk.iParts)
+            queChunks.prepend(iChunk);
+        if(!bRefreshing) {
+            if(MPD_MAX_URL_REFRESHES<=iRefreshes) {
+                this->finish(false,sError);
+                return;
+            }
+            qDebug() << "Refreshing URL"
+                     << "Attempt:" << iRefreshes+1
+                     << "Error:" << sError;
+            bRefreshing=true;
+            iRefreshes++;
+            emit refreshNeeded(uiSession);
+        }
+        return;
+    }
+    // A failure only matters when no other part is working on the same chunk.
+    if(!sError.isEmpty()&&!mpcChunk.bFinished&&!mpcChunk.iParts) {
+        if(!bTransient||mpcChunk.iRetries>=mpsSettings.iMaxRetries) {
+            this->finish(false,sError);
+            return;
+        }
+        qDebug() << "Retrying chunk"
+                 << "Chunk:" << iChunk
+                 << "Attempt:" << mpcChunk.iRetries+1
+                 << "Error:" << sError;
+        this->scheduleRetry(iChunk);
+    }
+    // Takes the next chunk (if any) from the queue.
+    this->launchParts();
+}
+
+/**
+ * @brief Gets the maximum number of parts the download can run right now, by itself.
+ *
+ * @return the configured maximum, or the auto-tuned value (which is never above it)
+ */
+int MPDWorker::partLimit() {
+    if(mpsSettings.bAutoTune)
+        return qMin(mpsSettings.iMaxParts,iTargetParts);
+    return mpsSettings.iMaxParts;
+}
+
+/**
+ * @brief Handles the end of the first request, when it ends before any response arrives.
+ */
+void MPDWorker::probeFinished() {
+    QString sError=nrpProbe->errorString();
+    if(QNetworkReply::NetworkError::NoError==nrpProbe->error())
+        sError=QStringLiteral("Empty response");
+    this->finish(false,sError);
+}
+
+/**
+ * @brief Handles the response headers of the first request, cuts the resource into chunks
+ * and starts downloading.
+ *
+ * A partial response (with a Content-Range) means the resource can be downloaded
+ * in parts: the request itself becomes the first part, and the rest of the chunks
+ * are queued. Any other successful response is the whole resource, which is then
+ * downloaded through that same request. When the resource matches the loaded
+ * journal, only the missing ranges are queued.
+ */
+void MPDWorker::probeResponded() {
+    uint                    uiResCode;
+    int                     iProbeChunk=-1;
+    quint64                 ui64RangeStart=0,ui64RangeEnd=0,
+                            ui64WindowEnd;
+    QRegularExpressionMatch rxmRange;
+    uiResCode=nrpProbe->attribute(
+        QNetworkRequest::Attribute::HttpStatusCodeAttribute
+    ).toUInt();
+    // Redirections are followed by the reply itself.
+    if(300<=uiResCode&&400>uiResCode)
+        return;
+    rxmRange=QRegularExpression(
+        QStringLiteral("^bytes\\s+(?:(\\d+)-(\\d+)|\\*)/(\\d+|\\*)$")
+    ).match(QString::fromUtf8(nrpProbe->rawHeader(QStringLiteral("Content-Range").toUtf8())).trimmed());
+    // An empty resource cannot satisfy any range.
+    if(416==uiResCode&&rxmRange.hasMatch()&&QStringLiteral("0")==rxmRange.captured(3)) {
+        if(nullptr!=fTarget)
+            if(!fTarget->resize(0)) {
+                this->finish(false,fTarget->errorString());
+                return;
+            }
+        this->finish(true,QString());
+        return;
+    }
+    if(200!=uiResCode&&206!=uiResCode) {
+        QString sError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
+        if(QNetworkReply::NetworkError::NoError!=nrpProbe->error())
+            sError=nrpProbe->errorString();
+        this->finish(false,sError);
+        return;
+    }
+    nrpProbe->disconnect(this);
+    // Sometimes the content length is not known in-advance.
+    // Without this value, is not possible to calculate the ranges.
+    bRanged=206==uiResCode&&
+            rxmRange.hasMatch()&&
+            !rxmRange.captured(1).isEmpty()&&
+            QStringLiteral("*")!=rxmRange.captured(3);
+    if(bRanged) {
+        ui64RangeStart=rxmRange.captured(1).toULongLong();
+        ui64RangeEnd=rxmRange.captured(2).toULongLong();
+        ui64ContentLength=rxmRange.captured(3).toULongLong();
+    }
+    else if(200==uiResCode)
+        ui64ContentLength=nrpProbe->header(
+            QNetworkRequest::KnownHeaders::ContentLengthHeader
+        ).toULongLong();
+    else
+        ui64ContentLength=0;
+    // Only a part of the resource is wanted: it's not possible without ranges.
+    if(!bRanged&&(mpsSettings.ui64RangeStart||mpsSettings.ui64RangeEnd)) {
+        this->finish(false,QStringLiteral("The server does not support byte ranges"));
+        return;
+    }
+    ui64WindowEnd=ui64ContentLength;
+    if(mpsSettings.ui64RangeEnd)
+        ui64WindowEnd=qMin(ui64WindowEnd,mpsSettings.ui64RangeEnd+1);
+    if(nullptr!=fTarget) {
+        // Resumes only when the journal and the partial file match the current resource, ...
+        // ... and only the ranges still matching their checksums (e.g. after a crash).
+        if(!bRanged||
+           ui64JournalSize!=ui64ContentLength||
+           (quint64)fTarget->size()!=ui64ContentLength)
+            mrlCompleted.clear();
+        else if(mrlCompleted.removeIf(
+                    [this](const MPDRange &r) {
+                        return !this->verifyRange(r);
+                    }
+                ))
+            qDebug() << "Corrupted ranges found in" << sJournalFile;
+        if(mrlCompleted.isEmpty()) {
+            QFile::remove(sJournalFile);
+            if(!fTarget->resize(0)) {
+                this->finish(false,fTarget->errorString());
+                return;
+            }
+        }
+        // Preallocates the whole target file at once, when its final size is known.
+        if(ui64ContentLength)
+            if(!MPDDiskWriter::preallocate(fTarget,ui64ContentLength)) {
+                this->finish(false,fTarget->errorString());
+                return;
+            }
+    }
+    if(bRanged) {
+        quint64 ui64Start=mpsSettings.ui64RangeStart;
+        // Queues only the missing ranges (which is everything, unless resuming).
+        for(const auto &r:qAsConst(mrlCompleted)) {
+            if(r.ui64Start>ui64Start)
+                this->queueRange(ui64Start,r.ui64Start-1);
+            ui64TotalDone+=r.ui64End-r.ui64Start+1;
+            ui64Start=r.ui64End+1;
+        }
+        if(ui64Start<ui64WindowEnd)
+            this->queueRange(ui64Start,ui64WindowEnd-1);
+        // The first request keeps going, as long as it matches the start of a chunk.
+        for(int iK=0;iK<mclChunks.count();iK++)
+            if(ui64RangeStart==mclChunks.at(iK).ui64Start&&ui64RangeEnd<=mclChunks.at(iK).ui64End) {
+                iProbeChunk=iK;
+                queChunks.removeOne(iK);
+                this->splitChunk(iK,ui64RangeEnd-ui64RangeStart+1);
+                break;
+            }
+    }
+    else {
+        // Takes the resource as a single chunk, when ranges are not possible.
+        this->queueRange(0,ui64ContentLength-1);
+        // A full response is the resource itself, so it's kept.
+        if(200==uiResCode) {
+            iProbeChunk=0;
+            queChunks.clear();
+        }
+    }
+    // In-memory downloads of a known size take their whole target at once: every part ...
+    // ... reads straight into its own slice, so there's nothing to join (nor copy) later.
+    if(nullptr!=abtTarget&&ui64WindowEnd>mpsSettings.ui64RangeStart) {
+        abtTarget->resize(ui64WindowEnd-mpsSettings.ui64RangeStart);
+        bInPlace=true;
+    }
+    if(-1==iProbeChunk) {
+        nrpProbe->abort();
+        nrpProbe->deleteLater();
+    }
+    else
+        this->attachPart(nrpProbe,iProbeChunk,0,i64ProbeSent);
+    nrpProbe=nullptr;
+    aui64Received.storeRelaxed(ui64TotalDone);
+    // Byte range downloads only count what's inside the range.
+    if(ui64WindowEnd>mpsSettings.ui64RangeStart)
+        ui64WindowEnd-=mpsSettings.ui64RangeStart;
+    else
+        ui64WindowEnd=0;
+    aui64Total.storeRelaxed(ui64WindowEnd);
+    if(nullptr!=mstTarget)
+        mstTarget->setSize(ui64WindowEnd);
+    if(mpsSettings.iStallTimeout)
+        tmrWatchdog->start();
+    if(mpsSettings.bAutoTune&&bRanged) {
+        i64TuneLast=etmClock.elapsed();
+        ui64TuneBytes=ui64TotalDone;
+        tmrTuner->start();
+    }
+    this->launchParts();
+}
+
+/**
+ * @brief Cuts a byte range into chunks of (at most) MPD_MAX_CHUNK_SIZE bytes, and queues them.
+ *
+ * The chunks are cut down again, to the current chunk size, when they're started.
+ *
+ * @param[in] ui64Start  range start
+ * @param[in] ui64End    range end (inclusive)
+ */
+void MPDWorker::queueRange(quint64 ui64Start,
+                           quint64 ui64End) {
+    do {
+        MPDChunk mpcChunk;
+        mpcChunk.ui64Start=ui64Start;
+        mpcChunk.ui64End=ui64Start+MPD_MAX_CHUNK_SIZE-1;
+        if(!bRanged||mpcChunk.ui64End>ui64End)
+            mpcChunk.ui64End=ui64End;
+        mpcChunk.ui64Done=0;
+        mpcChunk.bFinished=false;
+        mpcChunk.iParts=0;
+        mpcChunk.iRetries=0;
+        mpcChunk.abtDigest.clear();
+        queChunks.enqueue(mclChunks.count());
+        iChunksLeft++;
+        mclChunks.append(mpcChunk);
+        ui64Start=mpcChunk.ui64End+1;
+    } while(bRanged&&ui64Start<=ui64End);
+}
+
+/**
+ * @brief Adjusts the active parts to the connections currently granted by the scheduler.
+ *
+ * Excess parts are dropped (hedged ones first, then the ones with the most bytes left),
+ * and their chunks go back to the front of the queue, to be resumed later from the
+ * point they were left. Spare connections are used right away.
+ */
+void MPDWorker::rebalance() {
+    int iAllowed;
+    // Nothing to adjust until the chunks are known.
+    if(!bActive||nullptr!=nrpProbe)
+        return;
+    iAllowed=qMin(this->partLimit(),MPDScheduler::instance()->jobConnections(ui64Job));
+    while(iAllowed<mpmParts.count()) {
+        QNetworkReply *nrpVictim=nullptr;
+        quint64       ui64Left,ui64MaxLeft=0;
+        for(auto nrpReply:mpmParts.keys()) {
+            const MPDPart  &mppPart=mpmParts[nrpReply];
+            const MPDChunk &mpcChunk=mclChunks.at(mppPart.iChunk);
+            if(1<mpcChunk.iParts) {
+                nrpVictim=nrpReply;
+                break;
+            }
+            ui64Left=mpcChunk.ui64End+1-mppPart.ui64Start-mppPart.ui64Written;
+            if(nullptr==nrpVictim||ui64Left>ui64MaxLeft) {
+                ui64MaxLeft=ui64Left;
+                nrpVictim=nrpReply;
+            }
+        }
+        int iChunk=mpmParts.value(nrpVictim).iChunk;
+        this->dropPart(nrpVictim);
+        if(!mclChunks.at(iChunk).iParts)
+            queChunks.prepend(iChunk);
+    }
+    this->launchParts();
+}
+
+/**
+ * @brief Adds a finished chunk (and its checksum) to the completed ranges, and updates the resume journal.
+ *
+ * Only ranged file downloads are journaled: nothing else can be resumed.
+ *
+ * @param[in] iChunk  index of the chunk
+ */
+void MPDWorker::recordChunk(int iChunk) {
+    int      iK;
+    MPDRange mprRange;
+    if(nullptr==fTarget||!bRanged)
+        return;
+    mprRange.ui64Start=mclChunks.at(iChunk).ui64Start;
+    mprRange.ui64End=mclChunks.at(iChunk).ui64End;
+    mprRange.abtDigest=mclChunks.at(iChunk).abtDigest;
+    // Keeps the ranges sorted. They're not merged, so every chunk keeps its own checksum.
+    for(iK=0;iK<mrlCompleted.count();iK++)
+        if(mrlCompleted.at(iK).ui64Start>mprRange.ui64Start)
+            break;
+    mrlCompleted.insert(iK,mprRange);
+    // The chunk bytes may still be on their way to the disk, which is not waited for: ...
+    // ... the recorded ranges are checked against their checksums before resuming anyway.
+    if(!this->saveJournal())
+        qDebug() << "Unable to update the resume journal" << sJournalFile;
+}
+
+/**
+ * @brief Takes the throughput of a part which completed its chunk, as a per-part throughput sample.
+ *
+ * The chunk size follows the smoothed per-part throughput, so a single part spends
+ * about MPD_TUNE_CHUNK_TIME on every chunk, and always much more than the time it
+ * takes to get its first byte.
+ *
+ * @param[in] mppPart  the part
+ */
+void MPDWorker::sampleRate(const MPDPart &mppPart) {
+    double dSample,dSize;
+    if(!mpsSettings.bAutoTune||!bRanged||-1==mppPart.i64FirstByte||!mppPart.ui64Written)
+        return;
+    dSample=mppPart.ui64Written*1000.0/qMax<qint64>(1,etmClock.elapsed()-mppPart.i64FirstByte);
+    if(0==dPartRate)
+        dPartRate=dSample;
+    else
+        dPartRate=MPD_TUNE_EWMA_ALPHA*dSample+(1-MPD_TUNE_EWMA_ALPHA)*dPartRate;
+    dSize=qMax(
+        dPartRate*MPD_TUNE_CHUNK_TIME/1000,
+        dPartRate*dTTFB*MPD_TUNE_TTFB_RATIO/1000
+    );
+    // Keeps the size aligned to the pooled buffers.
+    ui64ChunkSize=qBound<quint64>(
+        MPD_MIN_CHUNK_SIZE,
+        (quint64)dSize/MPD_POOL_BUFFER_SIZE*MPD_POOL_BUFFER_SIZE,
+        MPD_MAX_CHUNK_SIZE
+    );
+}
+
+/**
+ * @brief Takes the time a part waited for its first byte, as a time-to-first-byte sample.
+ *
+ * @param[in] i64Elapsed  the time, in milliseconds
+ */
+void MPDWorker::sampleTTFB(qint64 i64Elapsed) {
+    if(0==dTTFB)
+        dTTFB=i64Elapsed;
+    else
+        dTTFB=MPD_TUNE_EWMA_ALPHA*i64Elapsed+(1-MPD_TUNE_EWMA_ALPHA)*dTTFB;
+}
+
+/**
+ * @brief Stores the auto-tuned values for the current host, so the next downloads start from them.
+ */
+void MPDWorker::saveTuning() {
+    QSettings stnTuning(
+        QSettings::Format::IniFormat,
+        QSettings::Scope::UserScope,
+        QStringLiteral("yay"),
+        QStringLiteral(MPD_TUNE_SETTINGS_GROUP)
+    );
+    QString   sHost=QUrl(sURL).host();
+    // Nothing was measured, so there's nothing worth keeping.
+    if(sHost.isEmpty()||0==dPartRate)
+        return;
+    stnTuning.beginGroup(sHost);
+    stnTuning.setValue(QStringLiteral("parts"),iTargetParts);
+    stnTuning.setValue(QStringLiteral("chunksize"),ui64ChunkSize);
+    stnTuning.setValue(QStringLiteral("ttfb"),qRound(dTTFB));
+    stnTuning.endGroup();
+}
+
+/**
+ * @brief Writes the resume journal, replacing the previous one atomically.
+ *
+ * @return true if the journal was written
+ */
+bool MPDWorker::saveJournal() {
+    QSaveFile   fJournal(sJournalFile);
+    QJsonObject jsnObj;
+    QJsonArray  jsnRanges;
+    for(const auto &r:qAsConst(mrlCompleted))
+        jsnRanges.append(
+            QJsonArray({
+                (qint64)r.ui64Start,
+                (qint64)r.ui64End,
+                QString::fromLatin1(r.abtDigest.toHex())
+            })
+        );
+    jsnObj.insert(
+        QStringLiteral("key"),
+        mpsSettings.sResumeKey.isEmpty()?sURL:mpsSettings.sResumeKey
+    );
+    jsnObj.insert(QStringLiteral("size"),(qint64)ui64ContentLength);
+    jsnObj.insert(QStringLiteral("ranges"),jsnRanges);
+    if(!fJournal.open(QFile::OpenModeFlag::WriteOnly))
+        return false;
+    fJournal.write(QJsonDocument(jsnObj).toJson(QJsonDocument::JsonFormat::Compact));
+    return fJournal.commit();
+}
+
+/**
+ * @brief Queues a failed chunk again, once its backoff delay expires.
+ *
+ * The delay doubles on every retry (up to MPD_RETRY_MAX_DELAY), and half of it
+ * is randomized, so the retries of several chunks do not hit the server at once.
+ *
+ * @param[in] iChunk  index of the chunk
+ */
+void MPDWorker::scheduleRetry(int iChunk) {
+    int  iDelay=MPD_RETRY_BASE_DELAY;
+    uint uiCurrentSession=uiSession;
+    for(int iK=0;iK<mclChunks.at(iChunk).iRetries&&MPD_RETRY_MAX_DELAY>iDelay;iK++)
+        iDelay*=2;
+    iDelay=qMin(iDelay,MPD_RETRY_MAX_DELAY);
+    iDelay=iDelay/2+QRandomGenerator::global()->bounded(iDelay/2+1);
+    mclChunks[iChunk].iRetries++;
+    // A struggling server is a sign of too many connections (but a burst of failures counts once).
+    if(mpsSettings.bAutoTune&&etmClock.elapsed()-i64TuneCut>=MPD_TUNE_INTERVAL) {
+        iTargetParts=qMax(1,iTargetParts/2);
+        i64TuneCut=etmClock.elapsed();
+    }
+    QTimer::singleShot(
+        iDelay,
+        this,
+        [this,iChunk,uiCurrentSession]() {
+            if(bActive&&uiCurrentSession==uiSession) {
+                queChunks.prepend(iChunk);
+                this->launchParts();
+            }
+        }
+    );
+}
+
+/**
+ * @brief Moves the bytes held back by the bandwidth cap, now that there could be tokens for them.
+ *
+ * Every call starts from a different part, so none of them gets all the tokens.
+ */
+void MPDWorker::resumeParts() {
+    QList<QNetworkReply *> lstReplies=mpmParts.keys();
+    if(!lstReplies.isEmpty()) {
+        iResumeTurn=(iResumeTurn+1)%lstReplies.count();
+        for(int iK=0;iK<lstReplies.count();iK++) {
+            QNetworkReply *nrpReply=lstReplies.at((iResumeTurn+iK)%lstReplies.count());
+            if(mpmParts.contains(nrpReply))
+                if(!this->writePart(nrpReply))
+                    break;
+        }
+    }
+}
+
+/**
+ * @brief Cuts a fresh chunk down to the given size, turning the rest of it into a new chunk.
+ *
+ * @param[in] iChunk      index of the chunk, which must not have received anything yet
+ * @param[in] ui64Size    the new chunk size
+ *
+ * @return index of the new chunk (not queued), or -1 if the chunk was not bigger than the size
+ */
+int MPDWorker::splitChunk(int     iChunk,
+                          quint64 ui64Size) {
+    MPDChunk mpcRest;
+    if(mclChunks.at(iChunk).ui64End-mclChunks.at(iChunk).ui64Start+1<=ui64Size)
+        return -1;
+    mpcRest=mclChunks.at(iChunk);
+    mpcRest.ui64Start=mpcRest.ui64Start+ui64Size;
+    mpcRest.iParts=0;
+    mpcRest.iRetries=0;
+    mclChunks[iChunk].ui64End=mclChunks.at(iChunk).ui64Start+ui64Size-1;
+    mclChunks.append(mpcRest);
+    iChunksLeft++;
+    return mclChunks.count()-1;
+}
+
+/**
+ * @brief Adjusts the number of parts from the aggregate throughput (additive increase,
+ * multiplicative decrease).
+ *
+ * A part is added as long as the last one made the download faster, and a quarter
+ * of them is taken away as soon as the throughput falls. Only the intervals in which
+ * every allowed part was busy with queued work count, since anything else says
+ * nothing about the link.
+ */
+void MPDWorker::tuneTimeout() {
+    qint64 i64Now=etmClock.elapsed();
+    double dRate=(ui64TotalDone-ui64TuneBytes)*1000.0/qMax<qint64>(1,i64Now-i64TuneLast);
+    bool   bSaturated=!queChunks.isEmpty()&&
+                      mpmParts.count()>=qMin(this->partLimit(),
+                                             MPDScheduler::instance()->jobConnections(ui64Job));
+    ui64TuneBytes=ui64TotalDone;
+    i64TuneLast=i64Now;
+    // The bandwidth cap (or a stream reader falling behind) is the bottleneck, not the link.
+    if(!bSaturated||MPDScheduler::instance()->getBandwidthCap()||
+       (nullptr!=mstTarget&&mstTarget->isFull()))
+        return;
+    if(0==dTuneRate||dRate>dTuneRate*(1+MPD_TUNE_GAIN))
+        iTargetParts=qMin(mpsSettings.iMaxParts,iTargetParts+1);
+    else if(dRate<dTuneRate*(1-MPD_TUNE_LOSS))
+        iTargetParts=qMax(1,iTargetParts*3/4);
+    dTuneRate=dRate;
+    this->launchParts();
+}
+
+/**
+ * @brief Checks every completed range of the target file against its checksum, once everything
+ * has been downloaded (only if requested).
+ *
+ * Corrupted ranges are queued again, so only those are fetched once more. The download
+ * fails if they keep coming up corrupted.
+ *
+ * @return true if the download can be considered finished
+ */
+bool MPDWorker::verifyDownload() {
+    MPDRangeList mrlCorrupted;
+    if(!mpsSettings.bVerify||nullptr==fTarget||!bRanged)
+        return true;
+    if(!mdwWriter->flush()) {
+        this->finish(false,mdwWriter->getLastError());
+        return false;
+    }
+    for(const auto &r:qAsConst(mrlCompleted))
+        if(!this->verifyRange(r))
+            mrlCorrupted.append(r);
+    if(mrlCorrupted.isEmpty())
+        return true;
+    if(++iVerifyPasses>mpsSettings.iMaxRetries) {
+        this->finish(
+            false,
+            QStringLiteral("Corrupted chunk: %1-%2").
+            arg(mrlCorrupted.at(0).ui64Start).
+            arg(mrlCorrupted.at(0).ui64End)
+        );
+        return false;
+    }
+    for(const auto &r:qAsConst(mrlCorrupted)) {
+        qDebug() << "Corrupted chunk"
+                 << "Range:" << r.ui64Start << "-" << r.ui64End;
+        mrlCompleted.removeIf(
+            [&r](const MPDRange &c) {
+                return c.ui64Start==r.ui64Start;
+            }
+        );
+        ui64TotalDone-=r.ui64End-r.ui64Start+1;
+        this->queueRange(r.ui64Start,r.ui64End);
+    }
+    aui64Received.storeRelaxed(ui64TotalDone);
+    if(!this->saveJournal())
+        qDebug() << "Unable to update the resume journal" << sJournalFile;
+    this->launchParts();
+    return false;
+}
+
+/**
+ * @brief Checks a range of the target file against its checksum.
+ *
+ * The writer must have been flushed first: the range is read back from the disk.
+ *
+ * @param[in] mprRange  the range
+ *
+ * @return true if the range matches its checksum (or if it has none)
+ */
+bool MPDWorker::verifyRange(const MPDRange &mprRange) {
+    bool               bResult=false;
+    quint64            ui64Left=mprRange.ui64End-mprRange.ui64Start+1;
+    QByteArray         abtBuffer;
+    QCryptographicHash crhRange(MPD_CHUNK_HASH_ALGORITHM);
+    if(mprRange.abtDigest.isEmpty())
+        return true;
+    if(fTarget->seek(mprRange.ui64Start)) {
+        abtBuffer=mbpPool.acquire();
+        while(ui64Left) {
+            qint64 i64Read=fTarget->read(
+                abtBuffer.data(),
+                qMin<quint64>(ui64Left,abtBuffer.size())
+            );
+            if(0>=i64Read)
+                break;
+            crhRange.addData(QByteArrayView(abtBuffer.constData(),i64Read));
+            ui64Left-=i64Read;
+        }
+        mbpPool.release(abtBuffer);
+        bResult=!ui64Left&&crhRange.result()==mprRange.abtDigest;
+    }
+    return bResult;
+}
+
+/**
+ * @brief Restarts the parts which have not received anything for too long.
+ *
+ * The chunk of a stalled part is resumed on a new connection, from the point it
+ * was left, unless another (hedged) part is still working on it.
+ */
+void MPDWorker::watchdogTimeout() {
+    qint64 i64Now=etmClock.elapsed();
+    bool   bRelaunch=false;
+    for(auto nrpReply:mpmParts.keys()) {
+        MPDPart mppPart=mpmParts.value(nrpReply);
+        // A part with unread bytes is being held (bandwidth cap or full stream), not by the network.
+        if(nrpReply->bytesAvailable())
+            continue;
+        if(i64Now-mppPart.i64LastActivity>=mpsSettings.iStallTimeout) {
+            qDebug() << "Stalled part"
+                     << "Chunk:" << mppPart.iChunk
+                     << "Offset:" << mppPart.ui64Start+mppPart.ui64Written;
+            this->dropPart(nrpReply);
+            // Puts the chunk back in front of the queue, since it's late already.
+            if(!mclChunks.at(mppPart.iChunk).iParts)
+                queChunks.prepend(mppPart.iChunk);
+            bRelaunch=true;
+        }
+    }
+    if(bRelaunch)
+        this->launchParts();
+}
+
+/**
+ * @brief Moves the bytes received so far by a part to the target, right at their own offset.
+ *
+ * The bytes are drained into fixed-size buffers taken from the pool, instead of
+ * being copied into a new allocation every time.
+ * The chunk grows as long as the bytes are contiguous to what it already has.
+ * The download is finished (with an error) if the target file cannot be written.
+ * Only the bytes the scheduler's token bucket allows are moved: the rest stay in
+ * the reply, and are moved later by resumeParts(). Nothing is moved while the
+ * target stream is full: the reply's buffer fills up and Qt stops reading from
+ * the socket, until the stream reader catches up.
+ *
+ * @param[in] nrpReply  the reply associated to the part
+ * @param[in] bDrain    true if every byte must be moved, regardless of the bandwidth cap
+ *                      (and of a full stream)
+ *
+ * @return true if the bytes were moved (or held back)
+ */
+bool MPDWorker::writePart(QNetworkReply *nrpReply,
+                          bool          bDrain) {
+    bool     bHeld=false;
+    MPDPart  &mppPart=mpmParts[nrpReply];
+    MPDChunk &mpcChunk=mclChunks[mppPart.iChunk];
+    // Drains the reply a buffer at a time, as long as the bandwidth cap allows it.
+    while(nrpReply->bytesAvailable()) {
+        QByteArray abtBuffer;
+        qint64     i64Read;
+        quint64    ui64Offset,ui64Relative,ui64NewDone;
+        // Resumed by the stream itself (see MPDStream::spaceAvailable()), not by the timer.
+        if(!bDrain&&nullptr!=mstTarget&&mstTarget->isFull()) {
+            bHeld=true;
+            break;
+        }
+        i64Read=MPDScheduler::instance()->acquireBandwidth(
+            qMin<qint64>(nrpReply->bytesAvailable(),mbpPool.bufferSize()),
+            bDrain
+        );
+        if(!i64Read)
+            break;
+        ui64Offset=mppPart.ui64Start+mppPart.ui64Written;
+        ui64Relative=ui64Offset-mpcChunk.ui64Start;
+        if(bInPlace) {
+            // Hedged parts read the very same bytes, so overlapping is harmless.
+            quint64 ui64Slice=ui64Offset-mpsSettings.ui64RangeStart;
+            // A server sending more than it announced just grows the target.
+            if((quint64)abtTarget->size()<ui64Slice+i64Read)
+                abtTarget->resize(ui64Slice+i64Read);
+            i64Read=nrpReply->read(abtTarget->data()+ui64Slice,i64Read);
+            if(0>=i64Read)
+                break;
+        }
+        else {
+            abtBuffer=mbpPool.acquire();
+            i64Read=nrpReply->read(abtBuffer.data(),i64Read);
+            if(0>=i64Read) {
+                mbpPool.release(abtBuffer);
+                break;
+            }
+            mbpPool.trackInFlight(i64Read);
+        }
+        // Checksums the bytes extending the chunk (only once, even when hedged), ...
+        // ... which always arrive in order: every part starts where its chunk was.
+        if(nullptr!=fTarget&&bRanged&&ui64Relative+i64Read>mpcChunk.ui64Done) {
+            qint64 i64Skip=mpcChunk.ui64Done-ui64Relative;
+            if(!mhmHashes.contains(mppPart.iChunk))
+                mhmHashes.insert(mppPart.iChunk,new QCryptographicHash(MPD_CHUNK_HASH_ALGORITHM));
+            mhmHashes.value(mppPart.iChunk)->addData(
+                QByteArrayView(abtBuffer.constData()+i64Skip,i64Read-i64Skip)
+            );
+        }
+        if(nullptr!=fTarget) {
+            // The writer takes the buffer over (releasing it once written).
+            if(!mdwWriter->write(std::move(abtBuffer),ui64Offset,i64Read)) {
+                this->finish(false,mdwWriter->getLastError());
+                return false;
+            }
+        }
+        else if(!bInPlace) {
+            // Hedged parts write the very same bytes, so overlapping is harmless.
+            if((quint64)mpcChunk.abtData.size()<ui64Relative+i64Read)
+                mpcChunk.abtData.resize(ui64Relative+i64Read);
+            memcpy(mpcChunk.abtData.data()+ui64Relative,abtBuffer.constData(),i64Read);
+            mbpPool.trackInFlight(-i64Read);
+            mbpPool.release(abtBuffer);
+        }
+        if(!mppPart.ui64Written) {
+            mppPart.i64FirstByte=etmClock.elapsed();
+            this->sampleTTFB(mppPart.i64FirstByte-mppPart.i64Launched);
+        }
+        mppPart.ui64Written+=i64Read;
+        mppPart.i64LastActivity=etmClock.elapsed();
+        // Every part starts where its chunk was, so there are no gaps.
+        ui64NewDone=mppPart.ui64Start+mppPart.ui64Written-mpcChunk.ui64Start;
+        if(ui64NewDone>mpcChunk.ui64Done) {
+            ui64TotalDone+=ui64NewDone-mpcChunk.ui64Done;
+            mpcChunk.ui64Done=ui64NewDone;
+            // Just a store: the progress is sampled (at its own pace) by MPDownloader.
+            aui64Received.storeRelaxed(ui64TotalDone);
+            // Only the chunk the stream is waiting for can move it forward.
+            if(nullptr!=mstTarget&&
+               mpcChunk.ui64Start<=ui64Streamed&&ui64Streamed<=mpcChunk.ui64End)
+                this->feedStream();
+        }
+    }
+    // Bytes held back are moved as soon as the bucket has tokens again.
+    if(!bHeld&&nrpReply->bytesAvailable()&&!tmrThrottle->isActive())
+        tmrThrottle->start(MPDScheduler::instance()->bandwidthDelay());
+    return true;
+}
+
+bool MPDownloader::bRefreshBusy=false;
 
 MPDownloader::MPDownloader() {
     bDownloading=false;
+    bLastResult=false;
     sLastError.clear();
-    namMPD=new QNetworkAccessManager();
+    mpsSettings.iMaxParts=MPD_MAX_DOWNLOAD_PARTS;
+    mpsSettings.mptTransport=MPDTransport::MPDT_HTTP1;
+    mpsSettings.iStallTimeout=MPD_DEFAULT_STALL_TIMEOUT;
+    mpsSettings.iHedgedParts=MPD_DEFAULT_HEDGED_PARTS;
+    mpsSettings.iMaxRetries=MPD_DEFAULT_MAX_RETRIES;
+    mpsSettings.sResumeKey.clear();
+    mpsSettings.mppPriority=MPDPriority::MPDP_NORMAL;
+    mpsSettings.bAutoTune=true;
+    mpsSettings.bVerify=false;
+    mpsSettings.bRefreshURL=false;
+    mpsSettings.ui64RangeStart=0;
+    mpsSettings.ui64RangeEnd=0;
+    urcbRefresh=nullptr;
+    lpRefreshData=nullptr;
+    sActiveURL.clear();
+    ui64LastReceived=0;
+    i64LastReport=0;
+    dRate=0;
+    tmrProgress.setInterval(MPD_DEFAULT_PROGRESS_INTERVAL);
+    connect(
+        &tmrProgress,
+        &QTimer::timeout,
+        this,
+        &MPDownloader::slot_progress_timeout
+    );
+    mpwWorker=new MPDWorker();
+    mpwWorker->moveToThread(&thrWorker);
+    connect(
+        &thrWorker,
+        &QThread::finished,
+        mpwWorker,
+        &QObject::deleteLater
+    );
+    connect(
+        mpwWorker,
+        &MPDWorker::finished,
+        this,
+        &MPDownloader::slot_worker_finished
+    );
+    connect(
+        mpwWorker,
+        &MPDWorker::refreshNeeded,
+        this,
+        &MPDownloader::slot_worker_refreshNeeded
+    );
+    thrWorker.start();
 }
 
 MPDownloader::~MPDownloader() {
-    delete namMPD;
+    // A queued cancelation could be left unprocessed once the thread quits, ...
+    // ... so the worker must be done cleaning up before.
+    if(bDownloading)
+        QMetaObject::invokeMethod(
+            mpwWorker,
+            [this]() {
+                mpwWorker->cancel();
+            },
+            Qt::ConnectionType::BlockingQueuedConnection
+        );
+    thrWorker.quit();
+    thrWorker.wait();
+}
+
+/**
+ * @brief Checks if an interrupted download left the given target file ready to be resumed.
+ *
+ * @param[in] sTargetFile  path of the target file
+ *
+ * @return true if there's a journal next to the target file
+ */
+bool MPDownloader::canResume(QString sTargetFile) {
+    return QFile::exists(sTargetFile+QStringLiteral(MPD_JOURNAL_SUFFIX));
 }
 
 /**
  * @brief Cancels the download forcefully.
+ *
+ * The download is not stopped right away: downloadFinished() is emitted once it does.
  */
 void MPDownloader::cancelDownload() {
-    bDownloading=false;
+    if(bDownloading)
+        QMetaObject::invokeMethod(
+            mpwWorker,
+            [this]() {
+                mpwWorker->cancel();
+            },
+            Qt::ConnectionType::QueuedConnection
+        );
 }
 
 /**
- * @brief Downloads the given resource with optional progress feedback.
+ * @brief Downloads the given resource to memory, with optional progress feedback.
  *
  * Performs a multi-parts download as long as the server supports the "Range" request header.
+ * Waits (without busy-waiting) until the download finishes.
  *
  * @param[in] sURL          URL containing the resource to be downloaded
  * @param[in] abtTarget     complete downloaded contents
@@ -68,159 +1790,34 @@ bool MPDownloader::download(QString            sURL,
                             QByteArray         &abtTarget,
                             DownloadProgressCB dpcbProgress,
                             void               *lpcbData) {
-    bool            bResult=false;
-    uint            uiResCode;
-    quint64         ui64ContentLength;
-    QNetworkRequest nrqMainRequest;
-    QNetworkReply   *nrpMainReply;
-    sLastError.clear();
-    abtTarget.clear();
-    nrqMainRequest.setUrl(QUrl(sURL));
-    nrqMainRequest.setHeader(
-        QNetworkRequest::KnownHeaders::UserAgentHeader,
-        QStringLiteral(MPD_HEADER_USER_AGENT_DEFAULT)
-    );
-    // Sends a HEAD request to check if the server supports the Range header
-    nrqMainRequest.setRawHeader(
-        QStringLiteral("Range").toUtf8(),
-        QStringLiteral("bytes=0-").toUtf8()
-    );
-    nrpMainReply=namMPD->head(nrqMainRequest);
-    while(!nrpMainReply->isFinished())
-        QApplication::processEvents(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
-    uiResCode=nrpMainReply->attribute(
-        QNetworkRequest::Attribute::HttpStatusCodeAttribute
-    ).toUInt();
-    ui64ContentLength=nrpMainReply->header(
-        QNetworkRequest::KnownHeaders::ContentLengthHeader
-    ).toULongLong();
-    if(QNetworkReply::NetworkError::NoError!=nrpMainReply->error())
-        sLastError=nrpMainReply->errorString();
-    else
-        if(200==uiResCode||206==uiResCode) {
-            bool            bRanged;
-            quint64         ui64K,
-                            ui64Start,ui64End,
-                            ui64TotalParts,ui64PartSize,ui64TotalFinished,
-                            ui64Progress[MPD_MAX_DOWNLOAD_PARTS];
-            QNetworkRequest nrqRequest[MPD_MAX_DOWNLOAD_PARTS];
-            QNetworkReply   *nrpReply[MPD_MAX_DOWNLOAD_PARTS];
-            // Sometimes the content length is not known in-advance.
-            // Without this value, is not possible to calculate the ranges.
-            bRanged=ui64ContentLength&&(206==uiResCode);
-            for(ui64K=0;ui64K<MPD_MAX_DOWNLOAD_PARTS;ui64K++) {
-                ui64Progress[ui64K]=0;
-                nrpReply[ui64K]=nullptr;
-            }
-            // Calculates the number of download parts needed.
-            ui64TotalParts=1;
-            if(bRanged) {
-                ui64TotalParts=ui64ContentLength/MPD_MIN_DOWNLOAD_PART_SIZE;
-                if(ui64ContentLength%MPD_MIN_DOWNLOAD_PART_SIZE)
-                    ui64TotalParts++;
-                if(ui64TotalParts>MPD_MAX_DOWNLOAD_PARTS)
-                    ui64TotalParts=MPD_MAX_DOWNLOAD_PARTS;
-            }
-            // Calculates the size (in bytes) by part.
-            ui64PartSize=ui64ContentLength/ui64TotalParts;
-            if(ui64ContentLength%ui64TotalParts)
-                ui64PartSize++;
-            ui64Start=0;
-            for(ui64K=0;ui64K<ui64TotalParts;ui64K++) {
-                // Calculates the range end for each part.
-                ui64End=ui64Start+ui64PartSize-1;
-                if(ui64End>ui64ContentLength-1)
-                    ui64End=ui64ContentLength-1;
-                nrqRequest[ui64K].setUrl(QUrl(sURL));
-                nrqRequest[ui64K].setHeader(
-                    QNetworkRequest::KnownHeaders::UserAgentHeader,
-                    QStringLiteral(MPD_HEADER_USER_AGENT_DEFAULT)
-                );
-                if(bRanged)
-                    // Sets the Range header (if possible) for the associated request.
-                    nrqRequest[ui64K].setRawHeader(
-                        QStringLiteral("Range").toUtf8(),
-                        QStringLiteral("bytes=%1-%2").arg(ui64Start).arg(ui64End).toUtf8()
-                    );
-                nrpReply[ui64K]=namMPD->get(nrqRequest[ui64K]);
-                // Creates a custom property, "index", to identify each response ...
-                // ... because it's not expected their signals to be triggered in order.
-                nrpReply[ui64K]->setProperty(
-                    QStringLiteral("index").toStdString().c_str(),
-                    ui64K
-                );
-                connect(
-                    nrpReply[ui64K],
-                    &QNetworkReply::downloadProgress,
-                    this,
-                    [&](qint64 bytesReceived,qint64 bytesTotal) {
-                        // Detects which response the emitted signal belongs to.
-                        QNetworkReply *nrpSender=qobject_cast<QNetworkReply *>(
-                                          QObject::sender()
-                                      );
-                        // Gets the index for the detected response.
-                        quint64       ui64Index=nrpSender->property(
-                                          QStringLiteral("index").toStdString().c_str()
-                                      ).toULongLong(),
-                                      ui64TotalProgress;
-                        // Calculates the amount of bytes downloaded so far.
-                        ui64Progress[ui64Index]=bytesReceived;
-                        ui64TotalProgress=0;
-                        for(ui64K=0;ui64K<ui64TotalParts;ui64K++)
-                            ui64TotalProgress+=ui64Progress[ui64K];
-                        // Invokes the callback with the current progress and user data.
-                        if(nullptr!=dpcbProgress)
-                            dpcbProgress(ui64TotalProgress,ui64ContentLength,lpcbData);
-                    }
-                );
-                // Calculates the range start for each part.
-                ui64Start+=ui64PartSize;
-            }
-            // Proceeds to wait for the download completion, once all parts have started.
-            bDownloading=true;
-            while(bDownloading) {
-                ui64TotalFinished=0;
-                for(ui64K=0;ui64K<ui64TotalParts;ui64K++)
-                    // Detects when a part has stopped (for good or bad).
-                    if(nrpReply[ui64K]->isFinished()) {
-                        uiResCode=nrpReply[ui64K]->attribute(
-                            QNetworkRequest::Attribute::HttpStatusCodeAttribute
-                        ).toUInt();
-                        if(QNetworkReply::NetworkError::NoError!=nrpReply[ui64K]->error()) {
-                            sLastError=nrpReply[ui64K]->errorString();
-                            break;
-                        }
-                        else
-                            if(200==uiResCode||206==uiResCode) {
-                                ui64TotalFinished++;
-                                // Once all parts are complete ...
-                                if(ui64TotalFinished==ui64TotalParts) {
-                                    // ... we have a success.
-                                    bResult=true;
-                                    break;
-                                }
-                            }
-                            else {
-                                sLastError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
-                                break;
-                            }
-                    }
-                if(ui64K<ui64TotalParts)
-                    break;
-                else
-                    QApplication::processEvents(QEventLoop::ProcessEventsFlag::AllEvents);
-            }
-            bDownloading=false;
-            // Proceeds to join the downloaded contents.
-            for(ui64K=0;ui64K<ui64TotalParts;ui64K++) {
-                if(bResult)
-                    abtTarget.append(nrpReply[ui64K]->readAll());
-                nrpReply[ui64K]->~QNetworkReply();
-            }
-        }
-        else
-            sLastError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
-    nrpMainReply->~QNetworkReply();
+    bool bResult=false;
+    if(this->startDownload(sURL,abtTarget))
+        bResult=this->waitForDownload(dpcbProgress,lpcbData);
+    return bResult;
+}
+
+/**
+ * @brief Downloads the given resource to a file, with optional progress feedback.
+ *
+ * Performs a multi-parts download as long as the server supports the "Range" request header.
+ * The target file is preallocated once and every part is written at its own range offset
+ * as soon as its bytes arrive, so the memory usage does not depend on the resource size.
+ * Waits (without busy-waiting) until the download finishes.
+ *
+ * @param[in] sURL          URL containing the resource to be downloaded
+ * @param[in] sTargetFile   path of the file receiving the downloaded contents
+ * @param[in] dpcbProgress  callback function receiving the progress and user data
+ * @param[in] lpcbData      customized user data to be passed to the callback
+ *
+ * @return true if every part was download successfully
+ */
+bool MPDownloader::download(QString            sURL,
+                            QString            sTargetFile,
+                            DownloadProgressCB dpcbProgress,
+                            void               *lpcbData) {
+    bool bResult=false;
+    if(this->startDownload(sURL,sTargetFile))
+        bResult=this->waitForDownload(dpcbProgress,lpcbData);
     return bResult;
 }
 
@@ -233,6 +1830,15 @@ QString MPDownloader::getLastError() {
     return sLastError;
 }
 
+/**
+ * @brief Gets the counters of the buffer pool the replies are drained into, for tuning purposes.
+ *
+ * @return the current counters
+ */
+MPDPoolStats MPDownloader::getPoolStats() {
+    return mpwWorker->poolStats();
+}
+
 /**
  * @brief Checks if a download is in progress.
  *
@@ -241,3 +1847,358 @@ QString MPDownloader::getLastError() {
 bool MPDownloader::isDownloading() {
     return bDownloading;
 }
+
+/**
+ * @brief Enables or disables the auto-tuning of the number of parts and the chunk size.
+ *
+ * When enabled, the download starts from the values learned for the same host (if any),
+ * adjusting them as the throughput is measured, and never going above the maximum
+ * number of parts. Takes effect on the next download.
+ *
+ * @param[in] bAutoTune  true to auto-tune, false to always use the maximum number of parts
+ */
+void MPDownloader::setAutoTune(bool bAutoTune) {
+    mpsSettings.bAutoTune=bAutoTune;
+}
+
+/**
+ * @brief Restricts the next downloads to a byte range of the resource.
+ *
+ * Only the bytes inside the range are downloaded (and counted in the progress).
+ * It requires a server supporting the Range header, and it's only available
+ * for in-memory and stream downloads.
+ *
+ * @param[in] ui64Start  range start
+ * @param[in] ui64End    range end, inclusive (0 for the end of the resource, and 0,0 for all of it)
+ */
+void MPDownloader::setRange(quint64 ui64Start,
+                            quint64 ui64End) {
+    mpsSettings.ui64RangeStart=ui64Start;
+    mpsSettings.ui64RangeEnd=ui64End;
+}
+
+/**
+ * @brief Sets the callback which gets a new URL for the resource, once the current one expires.
+ *
+ * Signed URLs stop working (403/410) after a while. When that happens in the middle
+ * of a download, the callback is given the expired URL to replace, and the download
+ * continues with the new one, fetching only what's left. Without a callback, an
+ * expired URL fails the download. Takes effect on the next download.
+ * The callbacks of every downloader in the process are serialized: a refresh needed
+ * while another one is running waits for it.
+ *
+ * @param[in] urcbCallback  callback function (or nullptr), called in the caller's thread
+ * @param[in] lpcbData      customized user data to be passed to the callback
+ */
+void MPDownloader::setURLRefresh(URLRefreshCB urcbCallback,
+                                 void         *lpcbData) {
+    urcbRefresh=urcbCallback;
+    lpRefreshData=lpcbData;
+}
+
+/**
+ * @brief Enables or disables the verification of a file download, once it's complete.
+ *
+ * Every chunk is checksummed as it arrives. When enabled, the target file is read
+ * back and checked against those checksums, and only the corrupted chunks are
+ * downloaded again. Takes effect on the next download.
+ *
+ * @param[in] bVerify  true to verify the downloaded file
+ */
+void MPDownloader::setVerify(bool bVerify) {
+    mpsSettings.bVerify=bVerify;
+}
+
+/**
+ * @brief Sets how many parts can duplicate the last outstanding chunks.
+ *
+ * Takes effect on the next download.
+ *
+ * @param[in] iHedgedParts  maximum number of hedged parts (0 disables hedging)
+ */
+void MPDownloader::setHedgedParts(int iHedgedParts) {
+    mpsSettings.iHedgedParts=qMax(0,iHedgedParts);
+}
+
+/**
+ * @brief Sets how many parts (connections) can download chunks at the same time.
+ *
+ * Takes effect on the next download.
+ *
+ * @param[in] iMaxParts  maximum number of parts (at least one)
+ */
+void MPDownloader::setMaxParts(int iMaxParts) {
+    mpsSettings.iMaxParts=qMax(1,iMaxParts);
+}
+
+/**
+ * @brief Sets how many times a chunk failing for transient reasons is retried.
+ *
+ * Takes effect on the next download.
+ *
+ * @param[in] iMaxRetries  maximum number of retries per chunk (0 disables retrying)
+ */
+void MPDownloader::setMaxRetries(int iMaxRetries) {
+    mpsSettings.iMaxRetries=qMax(0,iMaxRetries);
+}
+
+/**
+ * @brief Sets the priority of the next download, among the active ones in the process.
+ *
+ * Higher priority downloads get their connections first (taking them away from lower
+ * priority ones, if needed). The bandwidth cap is shared by every download alike.
+ * Both are configured process-wide, through MPDScheduler::instance().
+ * Takes effect on the next download.
+ *
+ * @param[in] mppPriority  the download priority
+ */
+void MPDownloader::setPriority(MPDPriority mppPriority) {
+    mpsSettings.mppPriority=mppPriority;
+}
+
+/**
+ * @brief Sets how often the progress is reported, while downloading.
+ *
+ * Reports are sampled from the running totals at this rate, no matter how fast
+ * the bytes arrive, so progress feedback costs next to nothing on fast links.
+ *
+ * @param[in] iInterval  interval between reports, in milliseconds (at least 10)
+ */
+void MPDownloader::setProgressInterval(int iInterval) {
+    tmrProgress.setInterval(qMax(10,iInterval));
+}
+
+/**
+ * @brief Sets the key identifying the resource of the next download, for resuming purposes.
+ *
+ * Needed when the same resource can be reached through different URLs (e.g. signed
+ * URLs which expire). An interrupted file download is only resumed when the key
+ * matches. Takes effect on the next download.
+ *
+ * @param[in] sResumeKey  the resource key (an empty string means the URL itself)
+ */
+void MPDownloader::setResumeKey(QString sResumeKey) {
+    mpsSettings.sResumeKey=sResumeKey;
+}
+
+/**
+ * @brief Sets how long a part can go without receiving bytes, before it's restarted.
+ *
+ * Takes effect on the next download.
+ *
+ * @param[in] iStallTimeout  timeout, in milliseconds (0 disables the stall detection)
+ */
+void MPDownloader::setStallTimeout(int iStallTimeout) {
+    mpsSettings.iStallTimeout=qMax(0,iStallTimeout);
+}
+
+/**
+ * @brief Sets the transport used to download the parts.
+ *
+ * Takes effect on the next download.
+ *
+ * @param[in] mptTransport  HTTP/1.1 (a connection per part) or HTTP/2 (multiplexed parts)
+ */
+void MPDownloader::setTransport(MPDTransport mptTransport) {
+    mpsSettings.mptTransport=mptTransport;
+}
+
+/**
+ * @brief Starts downloading the given resource to memory, without waiting.
+ *
+ * Progress is reported through downloadProgress() and the end of the download,
+ * through downloadFinished(). The target must stay alive until then.
+ *
+ * @param[in] sURL       URL containing the resource to be downloaded
+ * @param[in] abtTarget  complete downloaded contents
+ *
+ * @return true if the download was started
+ */
+bool MPDownloader::startDownload(QString    sURL,
+                                 QByteArray &abtTarget) {
+    abtTarget.clear();
+    return this->launchDownload(sURL,&abtTarget,QString(),nullptr);
+}
+
+/**
+ * @brief Starts downloading the given resource to a file, without waiting.
+ *
+ * Progress is reported through downloadProgress() and the end of the download,
+ * through downloadFinished().
+ *
+ * @param[in] sURL         URL containing the resource to be downloaded
+ * @param[in] sTargetFile  path of the file receiving the downloaded contents
+ *
+ * @return true if the download was started
+ */
+bool MPDownloader::startDownload(QString sURL,
+                                 QString sTargetFile) {
+    return this->launchDownload(sURL,nullptr,sTargetFile,nullptr);
+}
+
+/**
+ * @brief Starts downloading the given resource to a stream, without waiting.
+ *
+ * The bytes are handed over to the stream in order, as soon as they're contiguous,
+ * so they can be consumed while the download goes on (after anything the caller
+ * pushed in advance, e.g. the container headers). The stream is closed when
+ * the download finishes, and it must outlive it. Nothing is written to disk,
+ * so stream downloads cannot be resumed.
+ *
+ * @param[in] sURL       URL containing the resource to be downloaded
+ * @param[in] mstTarget  stream receiving the downloaded contents
+ *
+ * @return true if the download was started
+ */
+bool MPDownloader::startDownload(QString   sURL,
+                                 MPDStream *mstTarget) {
+    if(nullptr==mstTarget) {
+        sLastError=QStringLiteral("No target stream");
+        return false;
+    }
+    return this->launchDownload(sURL,nullptr,QString(),mstTarget);
+}
+
+/**
+ * @brief Hands a new download to the worker thread.
+ *
+ * @param[in] sURL         URL containing the resource to be downloaded
+ * @param[in] abtTarget    in-memory target (or nullptr)
+ * @param[in] sTargetFile  path of the target file (or an empty string)
+ * @param[in] mstTarget    stream target (or nullptr)
+ *
+ * @return true if the download was started
+ */
+bool MPDownloader::launchDownload(QString    sURL,
+                                  QByteArray *abtTarget,
+                                  QString    sTargetFile,
+                                  MPDStream  *mstTarget) {
+    if(bDownloading) {
+        sLastError=QStringLiteral("A download is already in progress");
+        return false;
+    }
+    // Files are written at the resource's own offsets (and journaled), so they take it all.
+    if(!sTargetFile.isEmpty()&&(mpsSettings.ui64RangeStart||mpsSettings.ui64RangeEnd)) {
+        sLastError=QStringLiteral("Byte ranges are only supported for in-memory and stream downloads");
+        return false;
+    }
+    sLastError.clear();
+    bLastResult=false;
+    bDownloading=true;
+    sActiveURL=sURL;
+    mpsSettings.bRefreshURL=nullptr!=urcbRefresh;
+    ui64LastReceived=0;
+    dRate=0;
+    // The worker is idle, but its totals still belong to the previous download.
+    mpwWorker->resetProgress();
+    etmProgress.start();
+    i64LastReport=0;
+    tmrProgress.start();
+    QMetaObject::invokeMethod(
+        mpwWorker,
+        [this,sURL,abtTarget,sTargetFile,mstTarget,mpsDownload=mpsSettings]() {
+            mpwWorker->start(sURL,abtTarget,sTargetFile,mstTarget,mpsDownload);
+        },
+        Qt::ConnectionType::QueuedConnection
+    );
+    return true;
+}
+
+/**
+ * @brief Waits for the active download to finish, with optional progress feedback.
+ *
+ * Runs a local event loop, so the caller's thread keeps processing events
+ * while the worker thread does the actual work.
+ *
+ * @param[in] dpcbProgress  callback function receiving the progress and user data
+ * @param[in] lpcbData      customized user data to be passed to the callback
+ *
+ * @return true if every part was download successfully
+ */
+bool MPDownloader::waitForDownload(DownloadProgressCB dpcbProgress,
+                                   void               *lpcbData) {
+    QEventLoop evlWait;
+    // Both connections are dropped as soon as the local event loop goes away.
+    if(nullptr!=dpcbProgress)
+        connect(
+            this,
+            &MPDownloader::downloadProgress,
+            &evlWait,
+            [=](quint64 ui64Received,quint64 ui64Total,quint64 ui64Rate,qint64 i64ETA) {
+                dpcbProgress(ui64Received,ui64Total,ui64Rate,i64ETA,lpcbData);
+            }
+        );
+    connect(
+        this,
+        &MPDownloader::downloadFinished,
+        &evlWait,
+        &QEventLoop::quit
+    );
+    if(bDownloading)
+        evlWait.exec();
+    return bLastResult;
+}
+
+void MPDownloader::slot_worker_finished(bool    bResult,
+                                        QString sError) {
+    // The last report is not skipped, so the final totals are always seen.
+    tmrProgress.stop();
+    this->slot_progress_timeout();
+    bDownloading=false;
+    bLastResult=bResult;
+    sLastError=sError;
+    emit downloadFinished(bResult);
+}
+
+void MPDownloader::slot_worker_refreshNeeded(uint uiSession) {
+    QString sNewURL=sActiveURL;
+    // The callbacks run one at a time: they can process events (e.g. loading a page), ...
+    // ... which would deliver the refresh of another download right in the middle.
+    if(bRefreshBusy) {
+        QTimer::singleShot(
+            MPD_REFRESH_RETRY_DELAY,
+            this,
+            [this,uiSession]() {
+                this->slot_worker_refreshNeeded(uiSession);
+            }
+        );
+        return;
+    }
+    // The callback runs here, in the caller's thread, since that's where it expects to be.
+    bRefreshBusy=true;
+    if(nullptr!=urcbRefresh&&urcbRefresh(sNewURL,lpRefreshData)&&!sNewURL.isEmpty())
+        sActiveURL=sNewURL;
+    else
+        sNewURL.clear();
+    bRefreshBusy=false;
+    QMetaObject::invokeMethod(
+        mpwWorker,
+        [this,uiSession,sNewURL]() {
+            mpwWorker->refreshURL(uiSession,sNewURL);
+        },
+        Qt::ConnectionType::QueuedConnection
+    );
+}
+
+void MPDownloader::slot_progress_timeout() {
+    quint64 ui64Received,ui64Total,ui64Rate=0;
+    qint64  i64Now=etmProgress.elapsed(),
+            i64ETA=-1;
+    mpwWorker->progressTotals(ui64Received,ui64Total);
+    // Nothing to tell when nothing has changed.
+    if(ui64Received==ui64LastReceived&&i64Now-i64LastReport<1000)
+        return;
+    if(i64Now>i64LastReport&&ui64Received>=ui64LastReceived) {
+        ui64Rate=(ui64Received-ui64LastReceived)*1000/(i64Now-i64LastReport);
+        // The ETA comes from a smoothed rate, so it does not jump on every report.
+        if(0==dRate)
+            dRate=ui64Rate;
+        else
+            dRate=MPD_PROGRESS_EWMA_ALPHA*ui64Rate+(1-MPD_PROGRESS_EWMA_ALPHA)*dRate;
+    }
+    if(ui64Total&&ui64Received<=ui64Total&&1<=dRate)
+        i64ETA=qCeil((ui64Total-ui64Received)/dRate);
+    ui64LastReceived=ui64Received;
+    i64LastReport=i64Now;
+    emit downloadProgress(ui64Received,ui64Total,ui64Rate,i64ETA);
+}
@@ -20,36 +20,324 @@
 #define MPDOWNLOADER_H
 
 #include <QtCore>
-#include <QApplication>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include "mpdbufferpool.h"
+#include "mpddiskwriter.h"
+#include "mpdscheduler.h"
+#include "mpdstream.h"
 
 /**
  * @brief The DownloadProgressCB typedef.
  *
  * Declares a callback function which receives the total downloaded bytes, the content
- * length and an optional customized user data, during the time a download is active.
+ * length, the current throughput (bytes per second), the estimated time left (seconds,
+ * or -1 if unknown) and an optional customized user data, during the time a download
+ * is active.
  */
-typedef void DownloadProgressCB(quint64,quint64,void *);
+typedef void DownloadProgressCB(quint64,quint64,quint64,qint64,void *);
+
+/**
+ * @brief The URLRefreshCB typedef.
+ *
+ * Declares a callback function which receives an expired URL (to be replaced with
+ * a new one for the same resource) and an optional customized user data. It returns
+ * true if the URL was refreshed.
+ */
+typedef bool URLRefreshCB(QString &,void *);
+
+/**
+ * @brief Available transports.
+ *
+ * HTTP/1.1 opens a connection per part, spread over as many access managers as needed,
+ * since each one limits the connections per host. HTTP/2 multiplexes every part over
+ * a single connection (when the server supports it).
+ */
+typedef enum {
+    MPDT_HTTP1,
+    MPDT_HTTP2
+} MPDTransport;
+
+/**
+ * @brief Download settings.
+ *
+ * Holds the tunable values for a download, as configured in MPDownloader.
+ */
+typedef struct {
+    int          iMaxParts;
+    MPDTransport mptTransport;
+    int          iStallTimeout;
+    int          iHedgedParts;
+    int          iMaxRetries;
+    QString      sResumeKey;
+    MPDPriority  mppPriority;
+    bool         bAutoTune;
+    bool         bVerify;
+    bool         bRefreshURL;
+    quint64      ui64RangeStart;
+    quint64      ui64RangeEnd;
+} MPDSettings;
+
+/**
+ * @brief A byte range (both ends inclusive), along with the checksum of its contents (if known).
+ */
+typedef struct {
+    quint64    ui64Start;
+    quint64    ui64End;
+    QByteArray abtDigest;
+} MPDRange;
+
+/**
+ * @brief A list of byte ranges.
+ */
+typedef QList<MPDRange> MPDRangeList;
+
+/**
+ * @brief Download chunk details.
+ *
+ * Holds the byte range of a single chunk, and how much of it has been received
+ * (contiguously, from the chunk start) by the parts working on it.
+ * In-memory downloads of unknown size also keep the chunk contents until the download
+ * finishes (the ones of a known size are written in place, straight to the target).
+ * Streamed downloads keep them until they're handed over.
+ * File downloads keep the chunk checksum, once it's complete.
+ */
+typedef struct {
+    quint64    ui64Start;
+    quint64    ui64End;
+    quint64    ui64Done;
+    bool       bFinished;
+    int        iParts;
+    int        iRetries;
+    QByteArray abtData;
+    QByteArray abtDigest;
+} MPDChunk;
+
+/**
+ * @brief A list of download chunks.
+ */
+typedef QList<MPDChunk> MPDChunkList;
+
+/**
+ * @brief Download part details.
+ *
+ * Holds the state of a single request in progress, which downloads a given chunk
+ * (or what's left of it) through its own connection.
+ */
+typedef struct {
+    int     iChunk;
+    int     iManager;
+    quint64 ui64Start;
+    quint64 ui64Written;
+    qint64  i64LastActivity;
+    qint64  i64Launched;
+    qint64  i64FirstByte;
+} MPDPart;
+
+/**
+ * @brief Running checksums of the chunks being downloaded, identified by their indexes.
+ */
+typedef QHash<int,QCryptographicHash *> MPDHashMap;
+
+/**
+ * @brief A pool of access managers, sharing the connections of a download.
+ */
+typedef QList<QNetworkAccessManager *> MPDManagerList;
+
+/**
+ * @brief Requests in progress, identified by their replies.
+ */
+typedef QHash<QNetworkReply *,MPDPart> MPDPartMap;
+
+/**
+ * @brief The MPDWorker class
+ *
+ * Performs the actual network work for MPDownloader, inside its own thread.
+ * QNetworkAccessManager opens at most six HTTP/1.1 connections per host, so the parts
+ * are spread over a pool of managers, to actually get the requested parallelism.
+ * Everything here is driven by the QNetworkReply signals, so no CPU is used
+ * while waiting for the network.
+ * The resource is cut into many bounded-size chunks, which are queued and then
+ * pulled by a fixed number of parts: a part finishing early just takes the next
+ * chunk, so a single slow connection does not hold the whole download back.
+ * Stalled parts are dropped and their chunks resumed on a new connection, and the
+ * last outstanding chunks can be hedged: duplicated on spare connections, keeping
+ * whichever finishes first.
+ * A chunk failing for transient reasons (5xx, 429, connection resets, etc) is retried
+ * a bounded number of times, with exponential backoff and jitter, resuming from its
+ * last received byte. Fatal responses (403, 404, etc) fail the download right away,
+ * unless the URL has just expired and it can be refreshed: then, the unfinished
+ * chunks continue with the new URL.
+ * File writes are handed over to an MPDDiskWriter, so the network is never held back
+ * by the disk (unless the writer falls too far behind).
+ * File downloads keep a journal next to the target file, recording the completed
+ * chunks along with their checksums (computed as the bytes arrive), so an interrupted
+ * download can be resumed later by fetching only the missing or corrupted ones.
+ * Every download is registered in the process-wide MPDScheduler, which decides how
+ * many connections it can actually use and how fast it can read. When the share of
+ * a download shrinks (e.g. an interactive download arrives), its excess parts are
+ * dropped and their chunks queued again.
+ * The number of parts and the chunk size can be auto-tuned, from the measured
+ * throughput and time-to-first-byte, and they're remembered for every host.
+ */
+class MPDWorker:public QObject {
+    Q_OBJECT
+private:
+    bool                    bActive;
+    bool                    bRanged;
+    bool                    bInPlace;
+    bool                    bRefreshing;
+    uint                    uiSession;
+    int                     iResumeTurn;
+    int                     iVerifyPasses;
+    int                     iRefreshes;
+    int                     iChunksLeft;
+    QString                 sURL;
+    quint64                 ui64ContentLength;
+    quint64                 ui64TotalDone;
+    quint64                 ui64Streamed;
+    QAtomicInteger<quint64> aui64Received;
+    QAtomicInteger<quint64> aui64Total;
+    quint64                 ui64JournalSize;
+    quint64                 ui64Job;
+    quint64                 ui64ProbeStart;
+    quint64                 ui64ProbeEnd;
+    int                     iTargetParts;
+    quint64                 ui64ChunkSize;
+    quint64                 ui64TuneBytes;
+    qint64                  i64TuneLast;
+    qint64                  i64TuneCut;
+    qint64                  i64ProbeSent;
+    double                  dTuneRate;
+    double                  dTTFB;
+    double                  dPartRate;
+    QString                 sJournalFile;
+    QByteArray              *abtTarget;
+    QFile                   *fTarget;
+    MPDDiskWriter           *mdwWriter;
+    MPDStream               *mstTarget;
+    QNetworkReply           *nrpProbe;
+    QTimer                  *tmrWatchdog;
+    QTimer                  *tmrThrottle;
+    QTimer                  *tmrTuner;
+    QElapsedTimer           etmClock;
+    MPDSettings             mpsSettings;
+    MPDBufferPool           mbpPool;
+    MPDManagerList          mmlManagers;
+    MPDChunkList            mclChunks;
+    QQueue<int>             queChunks;
+    MPDPartMap              mpmParts;
+    MPDRangeList            mrlCompleted;
+    MPDHashMap              mhmHashes;
+    void            attachPart(QNetworkReply *,int,int,qint64);
+    QNetworkRequest createRequest(bool=false,quint64=0,quint64=0);
+    void            createManagers();
+    void            dropPart(QNetworkReply *);
+    void            feedStream();
+    void            finish(bool,QString);
+    bool            isTransientFailure(uint,QNetworkReply::NetworkError);
+    void            launchPart(int);
+    void            launchParts();
+    void            loadJournal();
+    void            loadTuning();
+    void            partFinished(QNetworkReply *);
+    int             partLimit();
+    void            probeFinished();
+    void            probeResponded();
+    void            queueRange(quint64,quint64);
+    void            rebalance();
+    void            recordChunk(int);
+    void            resumeParts();
+    void            sampleRate(const MPDPart &);
+    void            sampleTTFB(qint64);
+    bool            saveJournal();
+    void            saveTuning();
+    void            scheduleRetry(int);
+    int             splitChunk(int,quint64);
+    void            tuneTimeout();
+    bool            verifyDownload();
+    bool            verifyRange(const MPDRange &);
+    void            watchdogTimeout();
+    bool            writePart(QNetworkReply *,bool=false);
+public:
+    MPDWorker();
+    ~MPDWorker();
+    void         cancel();
+    MPDPoolStats poolStats();
+    void         progressTotals(quint64 &,quint64 &);
+    void         refreshURL(uint,QString);
+    void         resetProgress();
+    void         start(QString,QByteArray *,QString,MPDStream *,MPDSettings);
+signals:
+    void finished(bool,QString);
+    void refreshNeeded(uint);
+};
 
 /**
  * @brief The MPDownloader class
  *
  * Provides a way of splitting the download of a given resource into multiple parts.
+ * The downloaded contents can be either collected in memory, streamed straight
+ * to a target file (in which case every part is written at its own offset), or
+ * handed over in order to an MPDStream, to be consumed while they're downloaded.
+ * The network work happens in a separate thread: downloads can be started
+ * asynchronously (reporting through signals) or waited for, without busy-waiting.
+ * The progress is sampled from the worker's running totals at a fixed rate, so the
+ * reports do not depend on how often the bytes arrive.
  */
 class MPDownloader:public QObject {
+    Q_OBJECT
 private:
-    bool                  bDownloading;
-    QString               sLastError;
-    QNetworkAccessManager *namMPD;
+    static bool   bRefreshBusy;
+    bool          bDownloading;
+    bool          bLastResult;
+    QString       sLastError;
+    QString       sActiveURL;
+    URLRefreshCB  *urcbRefresh;
+    void          *lpRefreshData;
+    quint64       ui64LastReceived;
+    qint64        i64LastReport;
+    double        dRate;
+    QThread       thrWorker;
+    QTimer        tmrProgress;
+    QElapsedTimer etmProgress;
+    MPDSettings   mpsSettings;
+    MPDWorker     *mpwWorker;
+    bool launchDownload(QString,QByteArray *,QString,MPDStream *);
+    bool waitForDownload(DownloadProgressCB,void *);
+private slots:
+    void slot_worker_finished(bool,QString);
+    void slot_worker_refreshNeeded(uint);
+    void slot_progress_timeout();
 public:
     MPDownloader();
     ~MPDownloader();
-    void    cancelDownload();
-    bool    download(QString,QByteArray &,DownloadProgressCB=nullptr,void * =nullptr);
-    QString getLastError();
-    bool    isDownloading();
+    static bool  canResume(QString);
+    void         cancelDownload();
+    bool         download(QString,QByteArray &,DownloadProgressCB=nullptr,void * =nullptr);
+    bool         download(QString,QString,DownloadProgressCB=nullptr,void * =nullptr);
+    QString      getLastError();
+    MPDPoolStats getPoolStats();
+    bool         isDownloading();
+    void         setAutoTune(bool);
+    void         setHedgedParts(int);
+    void         setMaxParts(int);
+    void         setMaxRetries(int);
+    void         setPriority(MPDPriority);
+    void         setProgressInterval(int);
+    void         setRange(quint64,quint64=0);
+    void         setResumeKey(QString);
+    void         setStallTimeout(int);
+    void         setTransport(MPDTransport);
+    void         setURLRefresh(URLRefreshCB,void * =nullptr);
+    void         setVerify(bool);
+    bool         startDownload(QString,QByteArray &);
+    bool         startDownload(QString,QString);
+    bool         startDownload(QString,MPDStream *);
+signals:
+    void downloadFinished(bool);
+    void downloadProgress(quint64,quint64,quint64,qint64);
 };
 
 #endif // MPDOWNLOADER_H
@@ -0,0 +1,281 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mpdscheduler.h"
+
+/**
+ * @brief Default number of connections shared by every active download.
+ */
+#define MPDS_DEFAULT_CONNECTION_BUDGET 32
+
+/**
+ * @brief Time (in milliseconds) worth of tokens the bucket can hold, which bounds the bursts.
+ */
+#define MPDS_BUCKET_DEPTH 50
+
+/**
+ * @brief Minimum amount of tokens (in bytes) worth waking up a throttled reader for.
+ */
+#define MPDS_MIN_READ_SIZE 4096
+
+MPDScheduler::MPDScheduler() {
+    iConnectionBudget=MPDS_DEFAULT_CONNECTION_BUDGET;
+    ui64BandwidthCap=0;
+    ui64NextJob=1;
+    dTokens=0;
+    etmBucket.start();
+    mjmJobs.clear();
+}
+
+/**
+ * @brief Gets the process-wide scheduler.
+ *
+ * @return the scheduler instance
+ */
+MPDScheduler *MPDScheduler::instance() {
+    static MPDScheduler mpsInstance;
+    return &mpsInstance;
+}
+
+/**
+ * @brief Takes tokens from the bucket, before reading the corresponding bytes.
+ *
+ * Forced requests are always granted, leaving the bucket in debt: the next readers
+ * will wait longer, so the cap still holds on average.
+ *
+ * @param[in] ui64Wanted  the amount of bytes about to be read
+ * @param[in] bForce      true if the bytes must be read anyway
+ *
+ * @return the amount of bytes which can be read right now
+ */
+quint64 MPDScheduler::acquireBandwidth(quint64 ui64Wanted,
+                                       bool    bForce) {
+    quint64      ui64Result=ui64Wanted;
+    QMutexLocker mtlJobs(&mtxJobs);
+    if(ui64BandwidthCap) {
+        this->refillBucket();
+        if(!bForce)
+            ui64Result=qMin(ui64Wanted,(quint64)qMax(0.0,dTokens));
+        dTokens-=ui64Result;
+    }
+    return ui64Result;
+}
+
+/**
+ * @brief Gets how long a throttled reader should wait, before trying again.
+ *
+ * @return the delay, in milliseconds (0 if there are tokens available right now)
+ */
+int MPDScheduler::bandwidthDelay() {
+    int          iResult=0;
+    double       dNeeded;
+    QMutexLocker mtlJobs(&mtxJobs);
+    if(ui64BandwidthCap) {
+        this->refillBucket();
+        dNeeded=qMin((double)MPDS_MIN_READ_SIZE,(double)this->bucketDepth())-dTokens;
+        if(0<dNeeded)
+            iResult=qMax(1,qCeil(dNeeded*1000/ui64BandwidthCap));
+    }
+    return iResult;
+}
+
+/**
+ * @brief Gets the maximum amount of tokens the bucket can hold.
+ *
+ * @note Must be called with the jobs mutex locked.
+ *
+ * @return the bucket depth, in bytes
+ */
+quint64 MPDScheduler::bucketDepth() {
+    return qMax<quint64>(MPDS_MIN_READ_SIZE,ui64BandwidthCap*MPDS_BUCKET_DEPTH/1000);
+}
+
+/**
+ * @brief Hands the connection budget out among the registered jobs.
+ *
+ * Goes from the highest priority to the lowest one, giving a connection at a time
+ * to each job still wanting more (in registration order), so the jobs of the same
+ * priority get the same share. Lower priorities only get the leftovers.
+ *
+ * @note Must be called with the jobs mutex locked.
+ *
+ * @return true if any job got a different number of connections
+ */
+bool MPDScheduler::distributeConnections() {
+    bool               bChanged=false;
+    int                iLeft=iConnectionBudget;
+    QMap<quint64,int>  mapGranted;
+    for(auto j=mjmJobs.cbegin();j!=mjmJobs.cend();j++)
+        mapGranted.insert(j.key(),0);
+    for(int iPriority=MPDP_INTERACTIVE;iPriority<=MPDP_BULK;iPriority++) {
+        bool bWanting=true;
+        while(iLeft&&bWanting) {
+            bWanting=false;
+            for(auto j=mjmJobs.cbegin();j!=mjmJobs.cend()&&iLeft;j++)
+                if(iPriority==j.value().mppPriority&&
+                   mapGranted.value(j.key())<j.value().iDemand) {
+                    mapGranted[j.key()]++;
+                    iLeft--;
+                    bWanting=true;
+                }
+        }
+    }
+    for(auto j=mjmJobs.begin();j!=mjmJobs.end();j++)
+        if(j.value().iGranted!=mapGranted.value(j.key())) {
+            j.value().iGranted=mapGranted.value(j.key());
+            bChanged=true;
+        }
+    return bChanged;
+}
+
+/**
+ * @brief Gets the bandwidth cap shared by every active download.
+ *
+ * @return the cap, in bytes per second (0 means unlimited)
+ */
+quint64 MPDScheduler::getBandwidthCap() {
+    QMutexLocker mtlJobs(&mtxJobs);
+    return ui64BandwidthCap;
+}
+
+/**
+ * @brief Gets the number of connections shared by every active download.
+ *
+ * @return the connection budget
+ */
+int MPDScheduler::getConnectionBudget() {
+    QMutexLocker mtlJobs(&mtxJobs);
+    return iConnectionBudget;
+}
+
+/**
+ * @brief Gets the number of connections a job is allowed to use right now.
+ *
+ * @param[in] ui64Job  the job id
+ *
+ * @return the granted connections
+ */
+int MPDScheduler::jobConnections(quint64 ui64Job) {
+    QMutexLocker mtlJobs(&mtxJobs);
+    return mjmJobs.value(ui64Job,{MPDP_BULK,0,0}).iGranted;
+}
+
+/**
+ * @brief Adds the tokens earned since the last refill, up to the bucket depth.
+ *
+ * @note Must be called with the jobs mutex locked.
+ */
+void MPDScheduler::refillBucket() {
+    dTokens+=(double)ui64BandwidthCap*etmBucket.restart()/1000;
+    if(dTokens>this->bucketDepth())
+        dTokens=this->bucketDepth();
+}
+
+/**
+ * @brief Registers a new active download.
+ *
+ * @param[in] mppPriority  the download priority
+ * @param[in] iDemand      the number of connections the download could use
+ *
+ * @return the job id, to be used in the other calls
+ */
+quint64 MPDScheduler::registerJob(MPDPriority mppPriority,
+                                  int         iDemand) {
+    quint64 ui64Result;
+    bool    bChanged;
+    MPDJob  mpjJob;
+    mpjJob.mppPriority=mppPriority;
+    mpjJob.iDemand=qMax(0,iDemand);
+    mpjJob.iGranted=0;
+    mtxJobs.lock();
+    ui64Result=ui64NextJob++;
+    mjmJobs.insert(ui64Result,mpjJob);
+    bChanged=this->distributeConnections();
+    mtxJobs.unlock();
+    // Every job needs to know when its share changes, so the others can be preempted.
+    if(bChanged)
+        emit budgetChanged();
+    return ui64Result;
+}
+
+/**
+ * @brief Sets the bandwidth cap shared by every active download.
+ *
+ * @param[in] ui64Cap  the cap, in bytes per second (0 means unlimited)
+ */
+void MPDScheduler::setBandwidthCap(quint64 ui64Cap) {
+    mtxJobs.lock();
+    // Starts over with an empty bucket, so the new cap holds from now on.
+    ui64BandwidthCap=ui64Cap;
+    dTokens=0;
+    etmBucket.restart();
+    mtxJobs.unlock();
+    emit budgetChanged();
+}
+
+/**
+ * @brief Sets the number of connections shared by every active download.
+ *
+ * @param[in] iBudget  the connection budget (at least one)
+ */
+void MPDScheduler::setConnectionBudget(int iBudget) {
+    bool bChanged;
+    mtxJobs.lock();
+    iConnectionBudget=qMax(1,iBudget);
+    bChanged=this->distributeConnections();
+    mtxJobs.unlock();
+    if(bChanged)
+        emit budgetChanged();
+}
+
+/**
+ * @brief Updates the number of connections a job could use.
+ *
+ * Jobs running out of work should lower their demand, so others can use the spare connections.
+ *
+ * @param[in] ui64Job  the job id
+ * @param[in] iDemand  the number of connections the job could use
+ */
+void MPDScheduler::setJobDemand(quint64 ui64Job,
+                                int     iDemand) {
+    bool bChanged=false;
+    mtxJobs.lock();
+    if(mjmJobs.contains(ui64Job))
+        if(mjmJobs.value(ui64Job).iDemand!=qMax(0,iDemand)) {
+            mjmJobs[ui64Job].iDemand=qMax(0,iDemand);
+            bChanged=this->distributeConnections();
+        }
+    mtxJobs.unlock();
+    if(bChanged)
+        emit budgetChanged();
+}
+
+/**
+ * @brief Unregisters a finished download, releasing its connections.
+ *
+ * @param[in] ui64Job  the job id
+ */
+void MPDScheduler::unregisterJob(quint64 ui64Job) {
+    bool bChanged=false;
+    mtxJobs.lock();
+    if(mjmJobs.remove(ui64Job))
+        bChanged=this->distributeConnections();
+    mtxJobs.unlock();
+    if(bChanged)
+        emit budgetChanged();
+}
@@ -0,0 +1,91 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MPDSCHEDULER_H
+#define MPDSCHEDULER_H
+
+#include <QtCore>
+
+/**
+ * @brief Available download priorities.
+ *
+ * Interactive downloads are served first, bulk downloads only get what's left.
+ */
+typedef enum {
+    MPDP_INTERACTIVE,
+    MPDP_NORMAL,
+    MPDP_BULK
+} MPDPriority;
+
+/**
+ * @brief Scheduled job details.
+ *
+ * Holds the priority and the demand of a single active download,
+ * along with the connections currently granted to it.
+ */
+typedef struct {
+    MPDPriority mppPriority;
+    int         iDemand;
+    int         iGranted;
+} MPDJob;
+
+/**
+ * @brief Scheduled jobs, identified by their ids.
+ */
+typedef QMap<quint64,MPDJob> MPDJobMap;
+
+/**
+ * @brief The MPDScheduler class
+ *
+ * Coordinates every active download in the process. It owns a total connection
+ * budget, which is handed out fairly among the downloads of the highest priority
+ * first, and a bandwidth cap, enforced by a token bucket which every connection
+ * of every download draws from before reading. Downloads run in their own threads,
+ * so every method is thread-safe.
+ */
+class MPDScheduler:public QObject {
+    Q_OBJECT
+private:
+    int           iConnectionBudget;
+    quint64       ui64BandwidthCap;
+    quint64       ui64NextJob;
+    double        dTokens;
+    QElapsedTimer etmBucket;
+    QMutex        mtxJobs;
+    MPDJobMap     mjmJobs;
+    MPDScheduler();
+    quint64 bucketDepth();
+    bool    distributeConnections();
+    void    refillBucket();
+public:
+    static MPDScheduler *instance();
+    quint64 acquireBandwidth(quint64,bool=false);
+    int     bandwidthDelay();
+    quint64 getBandwidthCap();
+    int     getConnectionBudget();
+    int     jobConnections(quint64);
+    quint64 registerJob(MPDPriority,int);
+    void    setBandwidthCap(quint64);
+    void    setConnectionBudget(int);
+    void    setJobDemand(quint64,int);
+    void    unregisterJob(quint64);
+signals:
+    void budgetChanged();
+};
+
+#endif // MPDSCHEDULER_H
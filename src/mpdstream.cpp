@@ -0,0 +1,186 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mpdstream.h"
+
+/**
+ * @brief Maximum amount of bytes (pushed, but not read yet) before the stream is full.
+ */
+#define MPD_STREAM_MAX_BUFFERED 33554432
+
+/**
+ * @brief Creates an empty (open) stream.
+ *
+ * @param[in] objParent  parent object
+ */
+MPDStream::MPDStream(QObject *objParent):QObject(objParent) {
+    this->reset();
+}
+
+/**
+ * @brief Gets the amount of bytes pushed, but not read yet.
+ *
+ * @return the buffered bytes
+ */
+quint64 MPDStream::buffered() {
+    QMutexLocker mtlStream(&mtxStream);
+    return ui64Buffered;
+}
+
+/**
+ * @brief Marks the end of the stream. The bytes already pushed can still be read.
+ *
+ * Safe to be called from any thread.
+ *
+ * @param[in] bSuccess  true if the whole resource was pushed
+ * @param[in] sError    the error which stopped the download (if any)
+ */
+void MPDStream::close(bool    bSuccess,
+                      QString sError) {
+    QMutexLocker mtlStream(&mtxStream);
+    bClosed=true;
+    bResult=bSuccess;
+    sLastError=sError;
+    wcData.wakeAll();
+}
+
+/**
+ * @brief Gets the error which ended the stream (if any).
+ *
+ * @return the last error
+ */
+QString MPDStream::getLastError() {
+    QMutexLocker mtlStream(&mtxStream);
+    return sLastError;
+}
+
+/**
+ * @brief Tells whether the reader is too far behind, so no more bytes should be pushed
+ * until spaceAvailable() is emitted.
+ *
+ * Safe to be called from any thread. Pushing to a full stream still works: it's
+ * up to the download to hold back.
+ *
+ * @return true if the stream is full
+ */
+bool MPDStream::isFull() {
+    QMutexLocker mtlStream(&mtxStream);
+    return bFull;
+}
+
+/**
+ * @brief Appends the next bytes of the resource.
+ *
+ * Safe to be called from any thread.
+ *
+ * @param[in] abtData  the bytes, which must follow the ones pushed before
+ */
+void MPDStream::push(QByteArray abtData) {
+    if(abtData.isEmpty())
+        return;
+    QMutexLocker mtlStream(&mtxStream);
+    ui64Buffered+=abtData.size();
+    lstPending.append(abtData);
+    if(MPD_STREAM_MAX_BUFFERED<=ui64Buffered)
+        bFull=true;
+    wcData.wakeAll();
+}
+
+/**
+ * @brief Takes the next bytes of the resource, waiting for them if needed.
+ *
+ * Blocks the calling thread while waiting, so it must not be the thread running
+ * the download (nor any thread the download needs to make progress).
+ * Once a full stream is drained down to half its capacity, spaceAvailable() is emitted.
+ *
+ * @param[out] lpBuffer  buffer receiving the bytes
+ * @param[in]  iSize     maximum amount of bytes to take
+ *
+ * @return the amount of bytes taken, 0 at the end of the stream, or -1 if the download failed
+ */
+int MPDStream::read(char *lpBuffer,
+                    int  iSize) {
+    bool         bDrained=false,
+                 bFailed;
+    int          iRead=0;
+    QMutexLocker mtlStream(&mtxStream);
+    while(lstPending.isEmpty()&&!bClosed)
+        wcData.wait(&mtxStream);
+    while(iRead<iSize&&!lstPending.isEmpty()) {
+        const QByteArray &abtFront=lstPending.first();
+        int              iCopy=qMin<qint64>(iSize-iRead,abtFront.size()-i64FrontOffset);
+        memcpy(lpBuffer+iRead,abtFront.constData()+i64FrontOffset,iCopy);
+        iRead+=iCopy;
+        i64FrontOffset+=iCopy;
+        if(abtFront.size()==i64FrontOffset) {
+            lstPending.removeFirst();
+            i64FrontOffset=0;
+        }
+    }
+    ui64Buffered-=iRead;
+    // Leaves some room, so the download does not resume and hold back on every read.
+    if(bFull&&MPD_STREAM_MAX_BUFFERED/2>=ui64Buffered) {
+        bFull=false;
+        bDrained=true;
+    }
+    // Whatever was pushed before a failure is still handed over.
+    bFailed=!iRead&&!bResult;
+    mtlStream.unlock();
+    if(bDrained)
+        emit spaceAvailable();
+    if(bFailed)
+        return -1;
+    return iRead;
+}
+
+/**
+ * @brief Empties and reopens the stream, so it can be used for a new download.
+ */
+void MPDStream::reset() {
+    QMutexLocker mtlStream(&mtxStream);
+    bClosed=false;
+    bResult=false;
+    bFull=false;
+    ui64Size=0;
+    ui64Buffered=0;
+    i64FrontOffset=0;
+    sLastError.clear();
+    lstPending.clear();
+}
+
+/**
+ * @brief Sets the total size of the resource, once it's known.
+ *
+ * Safe to be called from any thread.
+ *
+ * @param[in] ui64Total  total size (0 if unknown)
+ */
+void MPDStream::setSize(quint64 ui64Total) {
+    QMutexLocker mtlStream(&mtxStream);
+    ui64Size=ui64Total;
+}
+
+/**
+ * @brief Gets the total size of the resource.
+ *
+ * @return the total size (0 if not known yet)
+ */
+quint64 MPDStream::size() {
+    QMutexLocker mtlStream(&mtxStream);
+    return ui64Size;
+}
@@ -0,0 +1,64 @@
+/*
+ * Part of the YAY downloader project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MPDSTREAM_H
+#define MPDSTREAM_H
+
+#include <QtCore>
+
+/**
+ * @brief The MPDStream class
+ *
+ * Hands the bytes of a download over to a reader, in order, as soon as they're
+ * contiguous to what was handed before. The download pushes the bytes (from any
+ * thread), and the reader takes them at its own pace (from a thread of its own,
+ * never the one feeding the download), blocking when it gets ahead of the
+ * download. Nothing is kept once read, so the stream can only be read forward.
+ * The pending bytes are bounded: once too many are waiting for the reader, the stream
+ * reports itself as full, so the download can hold its parts back until the reader
+ * drains it (see spaceAvailable()).
+ */
+class MPDStream:public QObject {
+    Q_OBJECT
+private:
+    bool              bClosed;
+    bool              bResult;
+    bool              bFull;
+    quint64           ui64Size;
+    quint64           ui64Buffered;
+    qint64            i64FrontOffset;
+    QString           sLastError;
+    QMutex            mtxStream;
+    QWaitCondition    wcData;
+    QList<QByteArray> lstPending;
+public:
+    MPDStream(QObject * =nullptr);
+    quint64 buffered();
+    void    close(bool,QString);
+    QString getLastError();
+    bool    isFull();
+    void    push(QByteArray);
+    int     read(char *,int);
+    void    reset();
+    void    setSize(quint64);
+    quint64 size();
+signals:
+    void spaceAvailable();
+};
+
+#endif // MPDSTREAM_H
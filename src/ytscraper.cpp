@@ -72,16 +72,93 @@ REGEX_JSON \
  */
 #define YTS_PLAYER_FIELD "PLAYER_JS_URL"
 
+/**
+ * @brief Maximum number of media entries validated at the same time.
+ *
+ * Every validation is a HEAD request, and they all go to the same few hosts.
+ */
+#define YTS_MAX_HEAD_REQUESTS 6
+
+/**
+ * @brief Folder (inside the user's cache folder) keeping the video players already parsed.
+ */
+#define YTS_PLAYER_CACHE_FOLDER "yay/players"
+
+/**
+ * @brief Maximum number of video players kept in the cache folder (the most recently used ones).
+ */
+#define YTS_PLAYER_CACHE_ENTRIES 4
+
+/**
+ * @brief Time (milliseconds) a cached video player is used without revalidating it.
+ *
+ * The video player URLs change with every new version, so this is just a safety net.
+ */
+#define YTS_PLAYER_CACHE_MAX_AGE 86400000
+
 YTScraper::YTScraper() {
+    bLazyValidation=false;
     sLastError.clear();
+    clearPlayerDetails(pldPlayer);
+    sLoadedPlayer.clear();
     namYTS=new QNetworkAccessManager();
-    webPlayer.profile()->setHttpUserAgent(QStringLiteral(YTS_HEADER_USER_AGENT_DEFAULT));
+    // Created on first use: native transformations never need it.
+    webPlayer=nullptr;
 }
 
 YTScraper::~YTScraper() {
+    delete webPlayer;
     delete namYTS;
 }
 
+/**
+ * @brief Checks a media entry against the headers of its actual file, completing the missing details.
+ *
+ * @param[in,out] meEntry            media entry (without size, or with an invalid type, if it does not match)
+ * @param[in]     sContentType       value of the "Content-Type" header
+ * @param[in]     ui64ContentLength  value of the "Content-Length" header
+ */
+void YTScraper::checkMediaEntry(MediaEntry &meEntry,
+                                QString    sContentType,
+                                quint64    ui64ContentLength) {
+    if(!meEntry.ui64Size)
+        meEntry.ui64Size=ui64ContentLength;
+    // Extra-checks that the collected media entry size ...
+    // ... matches the size of the actual file.
+    if(ui64ContentLength!=meEntry.ui64Size) {
+        qDebug() << "Ignored media"
+                 << "Tag:" << meEntry.uiFormatTag
+                 << "Mismatching content-length"
+                 << "Expected:" << meEntry.ui64Size
+                 << "Found:" << ui64ContentLength;
+        meEntry.ui64Size=0;
+    }
+    // Infers the MIME type of the media entry from the HTTP headers ...
+    // ... in case it was not available in the JSON video details.
+    if(MediaType::MT_INVALID==meEntry.mtMediaType) {
+        meEntry.sMIMEType=sContentType;
+        if(MIMETools::isType(meEntry.sMIMEType,QStringLiteral("video")))
+            if(meEntry.uiSampleRate)
+                meEntry.mtMediaType=MediaType::MT_VIDEO_AND_AUDIO;
+            else
+                meEntry.mtMediaType=MediaType::MT_VIDEO_ONLY;
+        else
+            if(MIMETools::isType(meEntry.sMIMEType,QStringLiteral("audio")))
+                meEntry.mtMediaType=MediaType::MT_AUDIO_ONLY;
+    }
+    // Extra-checks that the collected media entry MIME type ...
+    // ... matches the MIME type of the actual file.
+    if(1>MIMETools::compare(meEntry.sMIMEType,sContentType)) {
+        qDebug() << "Ignored media"
+                 << "Tag:" << meEntry.uiFormatTag
+                 << "Mismatching content-type"
+                 << "Expected:" << meEntry.sMIMEType
+                 << "Found:" << sContentType;
+        meEntry.mtMediaType=MediaType::MT_INVALID;
+    }
+    meEntry.bValidated=true;
+}
+
 /**
  * @brief Checks if the supplied video details are valid enough to work with.
  *
@@ -93,6 +170,26 @@ bool YTScraper::checkVideoDetails(const VideoDetails vdSource) {
     return !vdSource.sVideoID.isEmpty()&&!vdSource.melMediaEntries.isEmpty();
 }
 
+/**
+ * @brief Clears the supplied video player details structure.
+ *
+ * @param[out] pldTarget  video player details
+ */
+void YTScraper::clearPlayerDetails(PlayerDetails &pldTarget) {
+    pldTarget.sURL.clear();
+    pldTarget.sETag.clear();
+    pldTarget.sLastModified.clear();
+    pldTarget.i64Validated=0;
+    pldTarget.sSource.clear();
+    pldTarget.sHeader.clear();
+    pldTarget.sBody.clear();
+    pldTarget.sFooter.clear();
+    pldTarget.sObj.clear();
+    pldTarget.sParam.clear();
+    pldTarget.sFunction.clear();
+    pldTarget.dolOps.clear();
+}
+
 /**
  * @brief Clears the supplied video details structure.
  *
@@ -145,6 +242,77 @@ QString YTScraper::createVideoURL(QString sVideoId) {
     return urlVideo.toString();
 }
 
+/**
+ * @brief Decodes a batch of ciphered signatures with the video player loaded into the
+ * decipher engine.
+ *
+ * Every signature is decoded in a single JS evaluation, so the whole batch costs just
+ * one round trip to the QWebEnginePage renderer.
+ *
+ * @param[in]  slCiphered    ciphered signatures
+ * @param[out] slDeciphered  deciphered signatures, in the same order (empty for the failed ones)
+ *
+ * @return true if the signature-decoding function was successfully invoked
+ */
+bool YTScraper::getEngineSignatures(const QStringList &slCiphered,
+                                    QStringList       &slDeciphered) {
+    bool    bResult=false,
+            bJSFinished=false;
+    QString sJSEnvelope,sPlayerObj;
+    sLastError.clear();
+    slDeciphered.clear();
+    if(nullptr==webPlayer) {
+        sLastError=QStringLiteral("The decipher engine is not loaded");
+        return false;
+    }
+    // Gets the video player global object name from the custom property.
+    sPlayerObj=webPlayer->property("objName").toString();
+    // Creates a JS function which returns an object with two properties:
+    // -"ready" is set to 1 once the ciphered signatures are decoded.
+    // -"values" is set to the deciphered signatures.
+    sJSEnvelope=QStringLiteral(
+        "(function() {"
+            "var jResult={ready:0,values:[]};"
+            "var jCiphered=%2;"
+            "for(var i=0;i<jCiphered.length;i++)"
+                "try {"
+                    "jResult.values.push(%1.decipher(jCiphered[i]));"
+                "} catch(e) {"
+                    "jResult.values.push(\"\");"
+                "}"
+            "jResult.ready=1;"
+            "return jResult;"
+        "}());"
+    ).arg(
+        sPlayerObj,
+        QString::fromUtf8(
+            QJsonDocument(QJsonArray::fromStringList(slCiphered)).toJson(QJsonDocument::JsonFormat::Compact)
+        )
+    );
+    // Runs the JS function and expects everything's OK.
+    webPlayer->runJavaScript(
+        sJSEnvelope,
+        [&](const QVariant &v) {
+            QJsonObject jsonObj=v.toJsonObject();
+            if(1==jsonObj.value(QStringLiteral("ready")).toInt()) {
+                const QJsonArray jsnValues=jsonObj.value(QStringLiteral("values")).toArray();
+                for(const auto &d:jsnValues)
+                    slDeciphered.append(d.toString());
+                bResult=slCiphered.count()==slDeciphered.count();
+            }
+            // The callback is always invoked, even if the JS code fails.
+            bJSFinished=true;
+        }
+    );
+    while(!bJSFinished)
+        QApplication::processEvents(QEventLoop::ProcessEventsFlag::EventLoopExec);
+    if(!bResult) {
+        slDeciphered.clear();
+        sLastError=QStringLiteral("Unable to decipher the signatures");
+    }
+    return bResult;
+}
+
 /**
  * @brief Gets the last error that has occurred.
  *
@@ -215,54 +383,9 @@ bool YTScraper::getVideoDetails(QString      sVideoId,
                     vdVideoDetails,
                     sLastError
                 )) {
-                    quint64    ui64ContentLength;
-                    QString    sError,sContentType;
-                    // Verifies that each returned link is valid and contains the correct media.
-                    for(auto &e:vdVideoDetails.melMediaEntries)
-                        if(this->getVideoHeaders(
-                            e.sURL,
-                            sContentType,
-                            ui64ContentLength,
-                            sError
-                        )) {
-                            if(!e.ui64Size)
-                                e.ui64Size=ui64ContentLength;
-                            // Extra-checks that the collected media entry size ...
-                            // ... matches the size of the actual file.
-                            if(ui64ContentLength!=e.ui64Size) {
-                                qDebug() << "Ignored media"
-                                         << "Tag:" << e.uiFormatTag
-                                         << "Mismatching content-length"
-                                         << "Expected:" << e.ui64Size
-                                         << "Found:" << ui64ContentLength;
-                                e.ui64Size=0;
-                            }
-                            // Infers the MIME type of the media entry from the HTTP headers ...
-                            // ... in case it was not available in the JSON video details.
-                            if(MediaType::MT_INVALID==e.mtMediaType) {
-                                e.sMIMEType=sContentType;
-                                if(MIMETools::isType(e.sMIMEType,QStringLiteral("video")))
-                                    if(e.uiSampleRate)
-                                        e.mtMediaType=MediaType::MT_VIDEO_AND_AUDIO;
-                                    else
-                                        e.mtMediaType=MediaType::MT_VIDEO_ONLY;
-                                else
-                                    if(MIMETools::isType(e.sMIMEType,QStringLiteral("audio")))
-                                        e.mtMediaType=MediaType::MT_AUDIO_ONLY;
-                            }
-                            // Extra-checks that the collected media entry MIME type ...
-                            // ... matches the MIME type of the actual file.
-                            if(1>MIMETools::compare(e.sMIMEType,sContentType)) {
-                                qDebug() << "Ignored media"
-                                         << "Tag:" << e.uiFormatTag
-                                         << "Mismatching content-type"
-                                         << "Expected:" << e.sMIMEType
-                                         << "Found:" << sContentType;
-                                e.mtMediaType=MediaType::MT_INVALID;
-                            }
-                        }
-                        else
-                            e.ui64Size=0;
+                    // Verifies that each returned link is valid and contains the correct media ...
+                    // ... (only the incomplete ones, when validating lazily).
+                    this->validateMediaEntries(vdVideoDetails.melMediaEntries,bLazyValidation);
                     // Removes the invalid / non-downloadable media entries.
                     vdVideoDetails.melMediaEntries.removeIf(
                         [](const auto &e) {
@@ -279,59 +402,6 @@ bool YTScraper::getVideoDetails(QString      sVideoId,
     return bResult;
 }
 
-/**
- * @brief Gets the media type and size from the supplied YT direct-download URL.
- *
- * Performs a quick HTTP HEAD request on a YT direct-download media URL
- * to obtain both "Content-Type" and "Content-Length" headers.
- *
- * @param[in]  sVideoURL          URL of the media file, ready to download
- * @param[out] sContentType       value of the "Content-Type" header (if available)
- * @param[out] ui64ContentLength  value of the "Content-Length" header (if available)
- * @param[out] sError             any communication or parsing error during/after the request
- *
- * @return true if the HEAD request succeeds (type and size can still be unavailable)
- */
-bool YTScraper::getVideoHeaders(QString sVideoURL,
-                                QString &sContentType,
-                                quint64 &ui64ContentLength,
-                                QString &sError) {
-    bool            bResult=false;
-    uint            uiResCode;
-    QNetworkRequest nrqRequest;
-    QNetworkReply   *nrpReply;
-    sContentType.clear();
-    ui64ContentLength=0;
-    sError.clear();
-    nrqRequest.setUrl(QUrl(sVideoURL));
-    nrqRequest.setHeader(
-        QNetworkRequest::KnownHeaders::UserAgentHeader,
-        QStringLiteral(YTS_HEADER_USER_AGENT_DEFAULT)
-    );
-    nrpReply=namYTS->head(nrqRequest);
-    while(!nrpReply->isFinished())
-        QApplication::processEvents(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
-    uiResCode=nrpReply->attribute(
-        QNetworkRequest::Attribute::HttpStatusCodeAttribute
-    ).toUInt();
-    if(QNetworkReply::NetworkError::NoError!=nrpReply->error())
-        sError=nrpReply->errorString();
-    else
-        if(200==uiResCode) {
-            sContentType=nrpReply->header(
-                QNetworkRequest::KnownHeaders::ContentTypeHeader
-            ).toString();
-            ui64ContentLength=nrpReply->header(
-                QNetworkRequest::KnownHeaders::ContentLengthHeader
-            ).toULongLong();
-            bResult=true;
-        }
-        else
-            sError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
-    nrpReply->~QNetworkReply();
-    return bResult;
-}
-
 /**
  * @brief Downloads the source code (HTML) of the YT video page.
  *
@@ -423,22 +493,27 @@ bool YTScraper::getVideoPlayerDecipherFunctionName(QString sPlayerSource,
 /**
  * @brief Downloads the source code (JS) of the YT video player.
  *
- * @param[in]  sPlayerURL     video player URL (extracted from the video HTML page)
- * @param[out] sPlayerSource  downloaded video player JS code
- * @param[out] sError         any communication or parsing error during/after the download
+ * When the supplied details have an entity tag or a modification date, the request
+ * is conditional: an unmodified video player is not downloaded again.
+ *
+ * @param[in]     sPlayerURL     video player URL (extracted from the video HTML page)
+ * @param[in,out] pldPlayer      video player details (source code and validators, updated if modified)
+ * @param[out]    bNotModified   true if the server reports the video player as not modified
+ * @param[out]    sError         any communication or parsing error during/after the download
  *
- * @return true if JS code was found in the supplied URL
+ * @return true if JS code was found in the supplied URL (or it was not modified)
  */
-bool YTScraper::getVideoPlayerSource(QString sPlayerURL,
-                                     QString &sPlayerSource,
-                                     QString &sError) {
+bool YTScraper::getVideoPlayerSource(QString       sPlayerURL,
+                                     PlayerDetails &pldPlayer,
+                                     bool          &bNotModified,
+                                     QString       &sError) {
     bool            bResult=false;
     uint            uiResCode;
     QString         sContentType;
     QUrl            urlPlayer;
     QNetworkRequest nrqRequest;
     QNetworkReply   *nrpReply;
-    sPlayerSource.clear();
+    bNotModified=false;
     sError.clear();
     urlPlayer.setUrl(sPlayerURL);
     if(urlPlayer.scheme().isEmpty())
@@ -450,6 +525,16 @@ bool YTScraper::getVideoPlayerSource(QString sPlayerURL,
         QNetworkRequest::KnownHeaders::UserAgentHeader,
         QStringLiteral(YTS_HEADER_USER_AGENT_DEFAULT)
     );
+    if(!pldPlayer.sETag.isEmpty())
+        nrqRequest.setRawHeader(
+            QByteArrayLiteral("If-None-Match"),
+            pldPlayer.sETag.toUtf8()
+        );
+    if(!pldPlayer.sLastModified.isEmpty())
+        nrqRequest.setRawHeader(
+            QByteArrayLiteral("If-Modified-Since"),
+            pldPlayer.sLastModified.toUtf8()
+        );
     nrpReply=namYTS->get(nrqRequest);
     while(!nrpReply->isFinished())
         QApplication::processEvents(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
@@ -462,9 +547,17 @@ bool YTScraper::getVideoPlayerSource(QString sPlayerURL,
     if(QNetworkReply::NetworkError::NoError!=nrpReply->error())
         sError=nrpReply->errorString();
     else
-        if(200==uiResCode)
+        if(304==uiResCode) {
+            bNotModified=true;
+            bResult=true;
+        }
+        else if(200==uiResCode)
             if(0==sContentType.indexOf(QStringLiteral("text/javascript"))) {
-                sPlayerSource=nrpReply->readAll();
+                pldPlayer.sSource=nrpReply->readAll();
+                pldPlayer.sETag=QString::fromUtf8(nrpReply->rawHeader(QByteArrayLiteral("ETag")));
+                pldPlayer.sLastModified=QString::fromUtf8(
+                    nrpReply->rawHeader(QByteArrayLiteral("Last-Modified"))
+                );
                 bResult=true;
             }
             else
@@ -476,50 +569,210 @@ bool YTScraper::getVideoPlayerSource(QString sPlayerURL,
 }
 
 /**
- * @brief Decodes a ciphered signature by running a tampered YT video player JS code.
+ * @brief Decodes a batch of ciphered signatures by running a tampered YT video player JS code.
  *
- * @param[in]  sCiphered    ciphered signature
- * @param[out] sDeciphered  deciphered signature
+ * The native transformations of the video player are applied, when available.
+ * Otherwise, the video player loaded into the decipher engine decodes them.
+ *
+ * @param[in]  slCiphered    ciphered signatures
+ * @param[out] slDeciphered  deciphered signatures, in the same order (empty for the failed ones)
  *
  * @return true if the signature-decoding function was successfully invoked
  */
-bool YTScraper::getVideoSignature(QString sCiphered,
-                                  QString &sDeciphered) {
-    bool    bResult=false;
-    int     iJSResult;
-    QString sJSEnvelope,sPlayerObj;
-    sLastError.clear();
-    sDeciphered.clear();
-    // Gets the video player global object name from the custom property.
-    sPlayerObj=webPlayer.property("objName").toString();
-    // Creates a JS function which returns an object with two properties:
-    // -"ready" is set to 1 once the ciphered signature is decoded.
-    // -"value" is set to the deciphered signature.
-    sJSEnvelope=QStringLiteral(
-        "(function() {"
-            "var jResult={ready:0,value:0};"
-            "jResult.value=%1.decipher(\"%2\");"
-            "jResult.ready=1;"
-            "return jResult;"
-        "}());"
-    ).arg(sPlayerObj,sCiphered);
-    iJSResult=0;
-    // Runs the JS function and expects everything's OK.
-    webPlayer.runJavaScript(
-        sJSEnvelope,
-        [&](const QVariant &v) {
-            QJsonObject jsonObj=v.toJsonObject();
-            if(jsonObj.contains(QStringLiteral("ready"))) {
-                iJSResult=jsonObj.value(QStringLiteral("ready")).toInt();
-                if(jsonObj.contains(QStringLiteral("value")))
-                    sDeciphered=jsonObj.value(QStringLiteral("value")).toString();
-                bResult=!sDeciphered.isEmpty();
+bool YTScraper::getVideoSignatures(const QStringList &slCiphered,
+                                   QStringList       &slDeciphered) {
+    slDeciphered.clear();
+    if(!pldPlayer.dolOps.isEmpty()) {
+        sLastError.clear();
+        for(const auto &c:slCiphered)
+            slDeciphered.append(DecipherTools::decipher(pldPlayer.dolOps,c));
+        return true;
+    }
+    return this->getEngineSignatures(slCiphered,slDeciphered);
+}
+
+/**
+ * @brief Loads a video player from the cache folder.
+ *
+ * @param[in]  sPlayerURL  video player URL
+ * @param[out] pldPlayer   cached video player details
+ *
+ * @return true if the video player was found in the cache folder
+ */
+bool YTScraper::loadCachedPlayer(QString       sPlayerURL,
+                                 PlayerDetails &pldPlayer) {
+    QFile         fCache(playerCacheFile(sPlayerURL));
+    QJsonDocument jsnDoc;
+    QJsonObject   jsnObj;
+    clearPlayerDetails(pldPlayer);
+    if(!fCache.open(QFile::OpenModeFlag::ReadWrite))
+        return false;
+    jsnDoc=QJsonDocument::fromJson(fCache.readAll());
+    // Marks the entry as recently used, so it's the last one to be pruned.
+    fCache.setFileTime(QDateTime::currentDateTime(),QFileDevice::FileTime::FileModificationTime);
+    fCache.close();
+    if(!jsnDoc.isObject())
+        return false;
+    jsnObj=jsnDoc.object();
+    if(sPlayerURL!=jsnObj.value(QStringLiteral("url")).toString())
+        return false;
+    pldPlayer.sURL=sPlayerURL;
+    pldPlayer.sETag=jsnObj.value(QStringLiteral("etag")).toString();
+    pldPlayer.sLastModified=jsnObj.value(QStringLiteral("modified")).toString();
+    pldPlayer.i64Validated=jsnObj.value(QStringLiteral("validated")).toVariant().toLongLong();
+    pldPlayer.sSource=jsnObj.value(QStringLiteral("source")).toString();
+    pldPlayer.sHeader=jsnObj.value(QStringLiteral("header")).toString();
+    pldPlayer.sBody=jsnObj.value(QStringLiteral("body")).toString();
+    pldPlayer.sFooter=jsnObj.value(QStringLiteral("footer")).toString();
+    pldPlayer.sObj=jsnObj.value(QStringLiteral("object")).toString();
+    pldPlayer.sParam=jsnObj.value(QStringLiteral("param")).toString();
+    pldPlayer.sFunction=jsnObj.value(QStringLiteral("function")).toString();
+    // Entries cached before the native transformations existed get them now.
+    if(jsnObj.contains(QStringLiteral("ops")))
+        DecipherTools::fromJson(jsnObj.value(QStringLiteral("ops")).toArray(),pldPlayer.dolOps);
+    else
+        DecipherTools::compile(pldPlayer.sSource,pldPlayer.sFunction,pldPlayer.dolOps);
+    return !pldPlayer.sFunction.isEmpty();
+}
+
+/**
+ * @brief Loads a video player into the internal QWebEnginePage, so it can decipher signatures.
+ *
+ * The QWebEnginePage (and the renderer process behind it) is only created the first
+ * time a video player without native transformations has to be run.
+ *
+ * @param[in] pldSource  video player details
+ *
+ * @return true if the video player was loaded
+ */
+bool YTScraper::loadDecipherEngine(const PlayerDetails &pldSource) {
+    bool                    bLoadFinished=false,
+                            bLoadFinishedOK=false;
+    QString                 sTamperedSource,sBodyAddendum;
+    QMetaObject::Connection mocLoad;
+    sLoadedPlayer.clear();
+    if(nullptr==webPlayer) {
+        webPlayer=new MyWebEnginePage();
+        webPlayer->profile()->setHttpUserAgent(QStringLiteral(YTS_HEADER_USER_AGENT_DEFAULT));
+        // A crashed renderer loses the decipher engine, which must be loaded again.
+        connect(
+            webPlayer,
+            &QWebEnginePage::renderProcessTerminated,
+            [this]() {
+                sLoadedPlayer.clear();
             }
-        }
+        );
+    }
+    // Adds a new method, "decipher", to the video player object ...
+    // ... which invokes the internal signature-decoding function.
+    // Additionally, forcefully returns a custom object to identify ...
+    // ... a "successfully loaded" condition.
+    sBodyAddendum=QStringLiteral(
+        "%1.decipher=%2;"
+        "return {ready:1};"
+    ).arg(pldSource.sParam,pldSource.sFunction);
+    // Places the new code right after the "body" section.
+    sTamperedSource=pldSource.sHeader+pldSource.sBody+sBodyAddendum+pldSource.sFooter;
+    mocLoad=connect(
+        webPlayer,
+        &QWebEnginePage::loadFinished,
+        [&](bool b) {
+             bLoadFinished=true; // Lambda won't be called outside loadDecipherEngine().
+             bLoadFinishedOK=b;  // Nothing is going out of scope here. Ignore warnings.
+         }
     );
-    while(!iJSResult)
+    // The video player global object name is the only value we need to use our ...
+    // ... new "decipher" function once the internal QWebEnginePage is configured.
+    // Hence, we set it to a custom property (avoiding the use of a member variable).
+    webPlayer->setProperty("objName",pldSource.sObj);
+    // Loads the simplest working HTML code since we only want to run JS code.
+    webPlayer->setHtml(QStringLiteral("<html><head></head><body></body></html>"));
+    while(!bLoadFinished)
         QApplication::processEvents(QEventLoop::ProcessEventsFlag::EventLoopExec);
-    return bResult;
+    disconnect(mocLoad); // Previous lambda's not being called beyond this point.
+    if(bLoadFinishedOK) {
+        int iJSResult=0;
+        // Runs our modified video player JS code and expects everything's OK.
+        webPlayer->runJavaScript(
+            sTamperedSource,
+            [&](const QVariant &v) {
+                QJsonObject jsonObj=v.toJsonObject();
+                if(jsonObj.contains(QStringLiteral("ready")))
+                    iJSResult=jsonObj.value(QStringLiteral("ready")).toInt();
+            }
+        );
+        while(!iJSResult)
+            QApplication::processEvents(QEventLoop::ProcessEventsFlag::EventLoopExec);
+        sLoadedPlayer=pldSource.sURL;
+    }
+    return bLoadFinishedOK;
+}
+
+/**
+ * @brief Gets the video player (and the sections and names extracted from it) for a given URL.
+ *
+ * Looks for it in memory first, then in the cache folder. A cached video player is
+ * used as-is for YTS_PLAYER_CACHE_MAX_AGE, and then revalidated with a conditional
+ * request: it's only downloaded (and parsed) again if it was modified.
+ *
+ * @param[in]  sPlayerURL  video player URL (extracted from the video HTML page)
+ * @param[out] sError      any communication or parsing error during/after the download
+ *
+ * @return true if the video player is ready to be used
+ */
+bool YTScraper::loadPlayer(QString sPlayerURL,
+                           QString &sError) {
+    bool          bNotModified;
+    qint64        i64Now=QDateTime::currentMSecsSinceEpoch();
+    PlayerDetails pldCandidate;
+    sError.clear();
+    if(pldPlayer.sURL==sPlayerURL)
+        pldCandidate=pldPlayer;
+    else if(!loadCachedPlayer(sPlayerURL,pldCandidate)) {
+        clearPlayerDetails(pldCandidate);
+        pldCandidate.sURL=sPlayerURL;
+    }
+    // A warm load skips both the download and the parsing.
+    if(!pldCandidate.sFunction.isEmpty()&&YTS_PLAYER_CACHE_MAX_AGE>i64Now-pldCandidate.i64Validated) {
+        pldPlayer=pldCandidate;
+        return true;
+    }
+    if(!this->getVideoPlayerSource(sPlayerURL,pldCandidate,bNotModified,sError)) {
+        // A stale video player is still better than none.
+        if(!pldCandidate.sFunction.isEmpty()) {
+            qDebug() << "Using a stale video player" << sPlayerURL << "Error:" << sError;
+            sError.clear();
+            pldPlayer=pldCandidate;
+            return true;
+        }
+        sError=QStringLiteral("Unable to get the video player source - %1").arg(sError);
+        return false;
+    }
+    if(!bNotModified||pldCandidate.sFunction.isEmpty()) {
+        // A modified video player must be loaded again into the decipher engine.
+        if(sLoadedPlayer==sPlayerURL)
+            sLoadedPlayer.clear();
+        if(!this->parseVideoPlayerSource(
+            pldCandidate.sSource,
+            pldCandidate.sHeader,
+            pldCandidate.sBody,
+            pldCandidate.sFooter,
+            pldCandidate.sObj,
+            pldCandidate.sParam,
+            pldCandidate.sFunction
+        )) {
+            sError=QStringLiteral("Unable to parse the video player source");
+            return false;
+        }
+        // Without native transformations, the video player itself deciphers the signatures.
+        if(!DecipherTools::compile(pldCandidate.sSource,pldCandidate.sFunction,pldCandidate.dolOps))
+            qDebug() << "Unable to extract the signature transformations" << sPlayerURL;
+    }
+    pldCandidate.i64Validated=i64Now;
+    pldPlayer=pldCandidate;
+    if(!saveCachedPlayer(pldPlayer))
+        qDebug() << "Unable to cache the video player" << sPlayerURL;
+    return true;
 }
 
 /**
@@ -541,6 +794,8 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
     QJsonArray      jsnFormats,jsnFormats2,jsnThumbnails;
     QJsonParseError jsnErr;
     MediaEntry      meEntry;
+    QStringList     slCiphers;
+    QList<int>      liCiphered;
     clearVideoDetails(vdVideoDetails);
     sError.clear();
     jsnDoc=QJsonDocument::fromJson(sJSON.toUtf8(),&jsnErr);
@@ -615,6 +870,7 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
         // ... to collect specific values for every entry
         for(const auto &f:qAsConst(jsnFormats))
             if(f.isObject()) {
+                QString sSignatureCipher;
                 jsnObj=f.toObject();
                 meEntry.mtMediaType=MediaType::MT_INVALID;
                 meEntry.sURL.clear();
@@ -629,6 +885,10 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
                 meEntry.uiFPS=0;
                 meEntry.uiDuration=0;
                 meEntry.ui64Size=0;
+                meEntry.ui64InitEnd=0;
+                meEntry.ui64IndexStart=0;
+                meEntry.ui64IndexEnd=0;
+                meEntry.bValidated=false;
                 // An available "url" attribute means that the media is free to download.
                 if(jsnObj.contains(QStringLiteral("url")))
                     if(jsnObj.value(QStringLiteral("url")).isString())
@@ -637,38 +897,13 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
                         ).toString();
                 // A missing "url" attribute means that the media is "protected" ...
                 // ... and the value must be inferred from the signature.
+                // Its signature is decoded later, along with every other one.
                 if(meEntry.sURL.isEmpty())
                     if(jsnObj.contains(QStringLiteral("signatureCipher")))
-                        if(jsnObj.value(QStringLiteral("signatureCipher")).isString()) {
-                            QString   sSignatureParamKey,sSignatureCiphered,sSignatureDeciphered;
-                            QUrl      urlVideo;
-                            QUrlQuery qryVideo;
-                            // "signatureCipher" is basically the query part of an URL.
-                            qryVideo.setQuery(
-                                jsnObj.value(QStringLiteral("signatureCipher")).toString()
-                            );
-                            // Extracts the ciphered signature.
-                            sSignatureCiphered=qryVideo.queryItemValue(QStringLiteral("s"));
-                            // Extracts the signature "key" that will hold the decoded ...
-                            // ... signature in the resulting media download URL.
-                            sSignatureParamKey=qryVideo.queryItemValue(QStringLiteral("sp"));
-                            // Decodes the ciphered signature.
-                            if(this->getVideoSignature(sSignatureCiphered,sSignatureDeciphered)) {
-                                // Creates the media download URL.
-                                urlVideo.setUrl(
-                                    qryVideo.queryItemValue(
-                                        QStringLiteral("url"),
-                                        QUrl::ComponentFormattingOption::FullyDecoded
-                                    )
-                                );
-                                qryVideo.setQuery(urlVideo.query());
-                                // Adds the "key=decoded signature" pair to the URL query.
-                                qryVideo.addQueryItem(sSignatureParamKey,sSignatureDeciphered);
-                                urlVideo.setQuery(qryVideo);
-                                // Adds the now downloadable URL to the media format entry.
-                                meEntry.sURL=urlVideo.url();
-                            }
-                        }
+                        if(jsnObj.value(QStringLiteral("signatureCipher")).isString())
+                            sSignatureCipher=jsnObj.value(
+                                QStringLiteral("signatureCipher")
+                            ).toString();
                 // Collects the other values, when available.
                 if(jsnObj.contains(QStringLiteral("quality")))
                     if(jsnObj.value(QStringLiteral("quality")).isString())
@@ -720,6 +955,24 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
                         meEntry.ui64Size=jsnObj.value(
                             QStringLiteral("contentLength")
                         ).toString().toULongLong();
+                // Adaptive formats tell where their headers and index (sidx/Cues) are.
+                if(jsnObj.contains(QStringLiteral("initRange"))&&jsnObj.contains(QStringLiteral("indexRange")))
+                    if(jsnObj.value(QStringLiteral("initRange")).isObject()&&
+                       jsnObj.value(QStringLiteral("indexRange")).isObject()) {
+                        QJsonObject jsnInit=jsnObj.value(QStringLiteral("initRange")).toObject(),
+                                    jsnIndex=jsnObj.value(QStringLiteral("indexRange")).toObject();
+                        meEntry.ui64InitEnd=jsnInit.value(QStringLiteral("end")).toString().toULongLong();
+                        meEntry.ui64IndexStart=jsnIndex.value(QStringLiteral("start")).toString().toULongLong();
+                        meEntry.ui64IndexEnd=jsnIndex.value(QStringLiteral("end")).toString().toULongLong();
+                        // Both ranges must be valid, for the index to be of any use.
+                        if(!meEntry.ui64InitEnd||
+                           meEntry.ui64IndexStart<=meEntry.ui64InitEnd||
+                           meEntry.ui64IndexEnd<meEntry.ui64IndexStart) {
+                            meEntry.ui64InitEnd=0;
+                            meEntry.ui64IndexStart=0;
+                            meEntry.ui64IndexEnd=0;
+                        }
+                    }
                 if(jsnObj.contains(QStringLiteral("mimeType")))
                     if(jsnObj.value(QStringLiteral("mimeType")).isString()) {
                         meEntry.sMIMEType=jsnObj.value(
@@ -743,10 +996,54 @@ bool YTScraper::parseQueryVideoResponse(QString      sJSON,
                     meEntry.sAudioQuality=QStringLiteral("medium");
                 else if(0==meEntry.sAudioQuality.compare(QStringLiteral("AUDIO_QUALITY_HIGH")))
                      meEntry.sAudioQuality=QStringLiteral("high");
-                // An existing URL is the only requisite for a media entry to be acceptable.
+                // An existing URL is the only requisite for a media entry to be acceptable ...
+                // ... (or a ciphered signature, which is decoded into the URL later).
                 if(!meEntry.sURL.isEmpty())
                     vdVideoDetails.melMediaEntries.append(meEntry);
+                else if(!sSignatureCipher.isEmpty()) {
+                    liCiphered.append(vdVideoDetails.melMediaEntries.count());
+                    slCiphers.append(sSignatureCipher);
+                    vdVideoDetails.melMediaEntries.append(meEntry);
+                }
+            }
+    // Decodes every ciphered signature at once, and creates the media download URLs.
+    if(!slCiphers.isEmpty()) {
+        QStringList slCiphered,slDeciphered;
+        // "signatureCipher" is basically the query part of an URL, ...
+        // ... and it includes the ciphered signature.
+        for(const auto &c:qAsConst(slCiphers))
+            slCiphered.append(QUrlQuery(c).queryItemValue(QStringLiteral("s")));
+        if(this->getVideoSignatures(slCiphered,slDeciphered))
+            for(int iK=0;iK<slCiphers.count();iK++) {
+                QString   sSignatureParamKey;
+                QUrl      urlVideo;
+                QUrlQuery qryVideo(slCiphers.at(iK));
+                if(slDeciphered.at(iK).isEmpty())
+                    continue;
+                // Extracts the signature "key" that will hold the decoded ...
+                // ... signature in the resulting media download URL.
+                sSignatureParamKey=qryVideo.queryItemValue(QStringLiteral("sp"));
+                // Creates the media download URL.
+                urlVideo.setUrl(
+                    qryVideo.queryItemValue(
+                        QStringLiteral("url"),
+                        QUrl::ComponentFormattingOption::FullyDecoded
+                    )
+                );
+                qryVideo.setQuery(urlVideo.query());
+                // Adds the "key=decoded signature" pair to the URL query.
+                qryVideo.addQueryItem(sSignatureParamKey,slDeciphered.at(iK));
+                urlVideo.setQuery(qryVideo);
+                // Adds the now downloadable URL to the media format entry.
+                vdVideoDetails.melMediaEntries[liCiphered.at(iK)].sURL=urlVideo.url();
             }
+        // The media entries which could not be deciphered are not downloadable.
+        vdVideoDetails.melMediaEntries.removeIf(
+            [](const auto &e) {
+                return e.sURL.isEmpty();
+            }
+        );
+    }
     // For simplicity, extracts the first video thumbnail.
     // The higher the index, the higher the resolution ...
     // ... but that's not important in this case.
@@ -872,10 +1169,155 @@ bool YTScraper::parseURL(QString sURL,
     return bResult;
 }
 
+/**
+ * @brief Gets the cache filepath of a given video player.
+ *
+ * @param[in] sPlayerURL  video player URL
+ *
+ * @return the cache filepath (named after a hash of the URL)
+ */
+QString YTScraper::playerCacheFile(QString sPlayerURL) {
+    return QStringLiteral("%1/%2/%3.json").
+           arg(
+               QStandardPaths::writableLocation(QStandardPaths::StandardLocation::GenericCacheLocation),
+               QStringLiteral(YTS_PLAYER_CACHE_FOLDER),
+               QString::fromLatin1(
+                   QCryptographicHash::hash(
+                       sPlayerURL.toUtf8(),
+                       QCryptographicHash::Algorithm::Sha1
+                   ).toHex()
+               )
+           );
+}
+
+/**
+ * @brief Gets the media type and size from a finished HEAD request.
+ *
+ * @param[in]  nrpReply           the finished reply
+ * @param[out] sContentType       value of the "Content-Type" header (if available)
+ * @param[out] ui64ContentLength  value of the "Content-Length" header (if available)
+ * @param[out] sError             any communication error during the request
+ *
+ * @return true if the HEAD request succeeded (type and size can still be unavailable)
+ */
+bool YTScraper::readVideoHeaders(QNetworkReply *nrpReply,
+                                 QString       &sContentType,
+                                 quint64       &ui64ContentLength,
+                                 QString       &sError) {
+    bool bResult=false;
+    uint uiResCode;
+    sContentType.clear();
+    ui64ContentLength=0;
+    sError.clear();
+    uiResCode=nrpReply->attribute(
+        QNetworkRequest::Attribute::HttpStatusCodeAttribute
+    ).toUInt();
+    if(QNetworkReply::NetworkError::NoError!=nrpReply->error())
+        sError=nrpReply->errorString();
+    else
+        if(200==uiResCode) {
+            sContentType=nrpReply->header(
+                QNetworkRequest::KnownHeaders::ContentTypeHeader
+            ).toString();
+            ui64ContentLength=nrpReply->header(
+                QNetworkRequest::KnownHeaders::ContentLengthHeader
+            ).toULongLong();
+            bResult=true;
+        }
+        else
+            sError=QStringLiteral("Unexpected response code: %1").arg(uiResCode);
+    return bResult;
+}
+
+/**
+ * @brief Gets new direct-download URLs for the media formats of a given YT video.
+ *
+ * The direct-download URLs expire after some hours, so a long (or resumed) download
+ * needs a fresh one. Every URL comes from the same load, so they all expire together:
+ * the video details are loaded again just once, and every media entry of the list gets
+ * its fresh URL. Only the media entry with the requested format tag is validated.
+ *
+ * @param[in]     sVideoId     video id
+ * @param[in]     uiFormatTag  format tag of the media entry which needs the fresh URL
+ * @param[in,out] melEntries   media entries, whose URLs are replaced with the fresh ones
+ *
+ * @return true if the requested media format is still available
+ */
+bool YTScraper::refreshMediaURLs(QString        sVideoId,
+                                 uint           uiFormatTag,
+                                 MediaEntryList &melEntries) {
+    bool         bResult=false,
+                 bLazy=bLazyValidation;
+    VideoDetails vdRefreshed;
+    bLazyValidation=true;
+    if(this->getVideoDetails(sVideoId,vdRefreshed)) {
+        for(auto &r:vdRefreshed.melMediaEntries) {
+            if(r.sURL.isEmpty())
+                continue;
+            if(uiFormatTag==r.uiFormatTag) {
+                if(!this->validateMediaEntry(r))
+                    continue;
+                bResult=true;
+            }
+            for(auto &e:melEntries)
+                if(r.uiFormatTag==e.uiFormatTag)
+                    e.sURL=r.sURL;
+        }
+        if(!bResult&&sLastError.isEmpty())
+            sLastError=QStringLiteral("Media format %1 is no longer available").arg(uiFormatTag);
+    }
+    bLazyValidation=bLazy;
+    return bResult;
+}
+
+/**
+ * @brief Saves a video player to the cache folder, pruning the least recently used ones.
+ *
+ * @param[in] pldPlayer  video player details
+ *
+ * @return true if the video player was saved
+ */
+bool YTScraper::saveCachedPlayer(const PlayerDetails &pldPlayer) {
+    QString       sCacheFile=playerCacheFile(pldPlayer.sURL);
+    QFileInfo     fiCache(sCacheFile);
+    QFileInfoList filEntries;
+    QSaveFile     fCache(sCacheFile);
+    QJsonObject   jsnObj;
+    if(!fiCache.absoluteDir().mkpath(QStringLiteral(".")))
+        return false;
+    jsnObj.insert(QStringLiteral("url"),pldPlayer.sURL);
+    jsnObj.insert(QStringLiteral("etag"),pldPlayer.sETag);
+    jsnObj.insert(QStringLiteral("modified"),pldPlayer.sLastModified);
+    jsnObj.insert(QStringLiteral("validated"),pldPlayer.i64Validated);
+    jsnObj.insert(QStringLiteral("source"),pldPlayer.sSource);
+    jsnObj.insert(QStringLiteral("header"),pldPlayer.sHeader);
+    jsnObj.insert(QStringLiteral("body"),pldPlayer.sBody);
+    jsnObj.insert(QStringLiteral("footer"),pldPlayer.sFooter);
+    jsnObj.insert(QStringLiteral("object"),pldPlayer.sObj);
+    jsnObj.insert(QStringLiteral("param"),pldPlayer.sParam);
+    jsnObj.insert(QStringLiteral("function"),pldPlayer.sFunction);
+    jsnObj.insert(QStringLiteral("ops"),DecipherTools::toJson(pldPlayer.dolOps));
+    if(!fCache.open(QFile::OpenModeFlag::WriteOnly))
+        return false;
+    fCache.write(QJsonDocument(jsnObj).toJson(QJsonDocument::JsonFormat::Compact));
+    if(!fCache.commit())
+        return false;
+    // The video players change every few days, so only the most recent ones are worth keeping.
+    filEntries=fiCache.absoluteDir().entryInfoList(
+        {QStringLiteral("*.json")},
+        QDir::Filter::Files,
+        QDir::SortFlag::Time
+    );
+    for(int iK=YTS_PLAYER_CACHE_ENTRIES;iK<filEntries.count();iK++)
+        QFile::remove(filEntries.at(iK).absoluteFilePath());
+    return true;
+}
+
 /**
  * @brief Configures the internal QWebEnginePage to be used for signatures dechipering.
  *
- * The deciphering engine STAYS ready to be used in the internal QWebEnginePage.
+ * The deciphering engine STAYS ready to be used in the internal QWebEnginePage, so
+ * it's only loaded again when the video player changes.
  *
  * @param[in]  sPlayerURL  video player URL (extracted from the video HTML page)
  * @param[out] sError      any communication or parsing error during/after the configuration
@@ -884,64 +1326,117 @@ bool YTScraper::parseURL(QString sURL,
  */
 bool YTScraper::setDecipherEngine(QString sPlayerURL,
                                   QString &sError) {
-    bool    bResult=false,
-            bLoadFinished=false,
-            bLoadFinishedOK=false;
-    QString sSource,sHeader,sBody,sFooter,sObj,sParam,sFunction;
+    bool bResult=false;
     sError.clear();
-    // Downloads the video player source code and extracts its logical sections.
-    if(this->getVideoPlayerSource(sPlayerURL,sSource,sError))
-        if(this->parseVideoPlayerSource(sSource,sHeader,sBody,sFooter,sObj,sParam,sFunction)) {
-            QString sTamperedSource,sBodyAddendum;
-            // Adds a new method, "decipher", to the video player object ...
-            // ... which invokes the internal signature-decoding function.
-            // Additionally, forcefully returns a custom object to identify ...
-            // ... a "successfully loaded" condition.
-            sBodyAddendum=QStringLiteral(
-                "%1.decipher=%2;"
-                "return {ready:1};"
-            ).arg(sParam,sFunction);
-            // Places the new code right after the "body" section.
-            sTamperedSource=sHeader+sBody+sBodyAddendum+sFooter;
-            connect(
-                &webPlayer,
-                &QWebEnginePage::loadFinished,
-                [&](bool b) {
-                     bLoadFinished=true; // Lambda won't be called outside setDecipherEngine().
-                     bLoadFinishedOK=b;  // Nothing is going out of scope here. Ignore warnings.
-                 }
-            );
-            // The video player global object name is the only value we need to use our ...
-            // ... new "decipher" function once the internal QWebEnginePage is configured.
-            // Hence, we set it to a custom property (avoiding the use of a member variable).
-            webPlayer.setProperty("objName",sObj);
-            // Loads the simplest working HTML code since we only want to run JS code.
-            webPlayer.setHtml(QStringLiteral("<html><head></head><body></body></html>"));
-            while(!bLoadFinished)
-                QApplication::processEvents(QEventLoop::ProcessEventsFlag::EventLoopExec);
-            disconnect(&webPlayer); // Previous lambda's not being called beyond this point.
-            if(bLoadFinishedOK) {
-                int iJSResult=0;
-                // Runs our modified video player JS code and expects everything's OK.
-                webPlayer.runJavaScript(
-                    sTamperedSource,
-                    [&](const QVariant &v) {
-                        QJsonObject jsonObj=v.toJsonObject();
-                        if(jsonObj.contains(QStringLiteral("ready")))
-                            iJSResult=jsonObj.value(QStringLiteral("ready")).toInt();
-                    }
-                );
-                while(!iJSResult)
-                    QApplication::processEvents(QEventLoop::ProcessEventsFlag::EventLoopExec);
-                bResult=true;
-            }
-        }
-        else
-            sError=QStringLiteral("Unable to parse the video player source");
-    else
-        sError=QStringLiteral("Unable to get the video player source - %1").arg(sError);
+    // Gets the video player source code and its logical sections (cached, if possible).
+    if(this->loadPlayer(sPlayerURL,sError)) {
+        // Native transformations do not need the video player to be running, ...
+        // ... and neither does the same video player already running.
+        if(!pldPlayer.dolOps.isEmpty()||sLoadedPlayer==sPlayerURL)
+            return true;
+        bResult=this->loadDecipherEngine(pldPlayer);
+    }
     if(!bResult)
         if(sError.isEmpty())
             sError=QStringLiteral("Unable to load the decipher engine");
     return bResult;
 }
+
+/**
+ * @brief Sets whether the media entries are validated lazily.
+ *
+ * Lazily, getVideoDetails() only validates the media entries with a missing size or
+ * type, and every other one is left for validateMediaEntry() (right before it's
+ * actually downloaded). Otherwise, every media entry is validated upfront.
+ *
+ * @param[in] bLazy  true to validate the media entries lazily
+ */
+void YTScraper::setLazyValidation(bool bLazy) {
+    bLazyValidation=bLazy;
+}
+
+/**
+ * @brief Validates a list of media entries, issuing their HEAD requests concurrently.
+ *
+ * At most YTS_MAX_HEAD_REQUESTS requests are in progress at the same time, and every
+ * entry is checked as soon as its response arrives. Entries which can't be validated
+ * are left without size (and the last request error is kept).
+ *
+ * @param[in,out] melEntries       media entries
+ * @param[in]     bIncompleteOnly  true to validate only the entries with a missing size or type
+ */
+void YTScraper::validateMediaEntries(MediaEntryList &melEntries,
+                                     bool           bIncompleteOnly) {
+    int                   iRunning=0;
+    QList<int>            lstPending;
+    QEventLoop            evlWait;
+    std::function<void()> fnLaunch;
+    for(int iK=0;iK<melEntries.count();iK++)
+        if(!bIncompleteOnly||
+           !melEntries.at(iK).ui64Size||
+           MediaType::MT_INVALID==melEntries.at(iK).mtMediaType)
+            lstPending.append(iK);
+    // Keeps the requests flowing: every finished one makes room for the next.
+    fnLaunch=[this,&iRunning,&lstPending,&evlWait,&fnLaunch,&melEntries]() {
+        while(YTS_MAX_HEAD_REQUESTS>iRunning&&!lstPending.isEmpty()) {
+            int             iEntry=lstPending.takeFirst();
+            QNetworkRequest nrqRequest;
+            QNetworkReply   *nrpReply;
+            nrqRequest.setUrl(QUrl(melEntries.at(iEntry).sURL));
+            nrqRequest.setHeader(
+                QNetworkRequest::KnownHeaders::UserAgentHeader,
+                QStringLiteral(YTS_HEADER_USER_AGENT_DEFAULT)
+            );
+            nrpReply=namYTS->head(nrqRequest);
+            iRunning++;
+            connect(
+                nrpReply,
+                &QNetworkReply::finished,
+                &evlWait,
+                [this,nrpReply,iEntry,&iRunning,&evlWait,&fnLaunch,&melEntries]() {
+                    quint64 ui64ContentLength;
+                    QString sContentType,sError;
+                    if(readVideoHeaders(nrpReply,sContentType,ui64ContentLength,sError))
+                        checkMediaEntry(melEntries[iEntry],sContentType,ui64ContentLength);
+                    else {
+                        melEntries[iEntry].ui64Size=0;
+                        sLastError=sError;
+                    }
+                    nrpReply->deleteLater();
+                    iRunning--;
+                    fnLaunch();
+                    if(!iRunning)
+                        evlWait.quit();
+                }
+            );
+        }
+    };
+    fnLaunch();
+    if(iRunning)
+        evlWait.exec(QEventLoop::ProcessEventsFlag::ExcludeUserInputEvents);
+}
+
+/**
+ * @brief Validates a single media entry (e.g. a lazily validated one, right before downloading it).
+ *
+ * An entry which was already validated gets no new HEAD request.
+ *
+ * @param[in,out] meEntry  media entry (completed with the details of its actual file)
+ *
+ * @return true if the media entry is valid and downloadable
+ */
+bool YTScraper::validateMediaEntry(MediaEntry &meEntry) {
+    sLastError.clear();
+    if(!meEntry.bValidated) {
+        MediaEntryList melEntry={meEntry};
+        this->validateMediaEntries(melEntry,false);
+        meEntry=melEntry.first();
+        if(!meEntry.bValidated)
+            return false;
+    }
+    if(!meEntry.ui64Size||MediaType::MT_INVALID==meEntry.mtMediaType) {
+        sLastError=QStringLiteral("Media format %1 does not match its file").arg(meEntry.uiFormatTag);
+        return false;
+    }
+    return true;
+}
@@ -25,6 +25,7 @@
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include "deciphertools.h"
 #include "mimetools.h"
 #include "unitsformat.h"
 
@@ -45,6 +46,9 @@ typedef enum {
  * @brief Media entry details.
  *
  * Holds the details for a single media entry, for a given YT video.
+ * Adaptive formats also have the byte ranges of their headers (which always
+ * start at 0) and of their index (0 when not available). Validated entries were
+ * already checked against their actual file (with a HEAD request).
  */
 typedef struct {
     MediaType mtMediaType;
@@ -60,6 +64,10 @@ typedef struct {
     uint      uiFPS;
     uint      uiDuration;
     quint64   ui64Size;
+    quint64   ui64InitEnd;
+    quint64   ui64IndexStart;
+    quint64   ui64IndexEnd;
+    bool      bValidated;
 } MediaEntry;
 
 /**
@@ -83,6 +91,28 @@ typedef struct {
     MediaEntryList melMediaEntries;
 } VideoDetails;
 
+/**
+ * @brief YT video player details.
+ *
+ * Holds the video player JS code (as downloaded), the sections and names extracted
+ * from it, the native signature transformations (when they could be extracted), and
+ * the values needed to revalidate it later (with a conditional request).
+ */
+typedef struct {
+    QString        sURL;
+    QString        sETag;
+    QString        sLastModified;
+    qint64         i64Validated;
+    QString        sSource;
+    QString        sHeader;
+    QString        sBody;
+    QString        sFooter;
+    QString        sObj;
+    QString        sParam;
+    QString        sFunction;
+    DecipherOpList dolOps;
+} PlayerDetails;
+
 /**
  * @brief The MyWebEnginePage class
  *
@@ -109,20 +139,39 @@ public:
  * @brief The YTScraper class
  *
  * Provides a way of grabbing information and downloadable links for YT videos.
+ * The links are validated against their actual files (through HEAD requests, issued
+ * concurrently), either all at once or lazily, right before they're downloaded.
+ * The video player (and what's extracted from it) is cached, both in memory and in
+ * the user's cache folder, since it only changes every few days.
+ * The signatures are deciphered natively, whenever the transformations applied by the
+ * video player can be extracted from its JS code. Otherwise, the video player itself
+ * is run in a QWebEnginePage (only created when it's first needed).
  */
 class YTScraper:public QObject {
 private:
+    bool                  bLazyValidation;
     QString               sLastError;
+    QString               sLoadedPlayer;
     QNetworkAccessManager *namYTS;
-    MyWebEnginePage       webPlayer;
-    bool getVideoHeaders(QString,QString &,quint64 &,QString &);
+    MyWebEnginePage       *webPlayer;
+    PlayerDetails         pldPlayer;
+    static void    checkMediaEntry(MediaEntry &,QString,quint64);
+    static void    clearPlayerDetails(PlayerDetails &);
+    static bool    loadCachedPlayer(QString,PlayerDetails &);
+    static QString playerCacheFile(QString);
+    static bool    readVideoHeaders(QNetworkReply *,QString &,quint64 &,QString &);
+    static bool    saveCachedPlayer(const PlayerDetails &);
+    bool getEngineSignatures(const QStringList &,QStringList &);
     bool getVideoHTML(QString,QString &,QString &);
     bool getVideoPlayerDecipherFunctionName(QString,QString &);
-    bool getVideoPlayerSource(QString,QString &,QString &);
-    bool getVideoSignature(QString,QString &);
+    bool getVideoPlayerSource(QString,PlayerDetails &,bool &,QString &);
+    bool getVideoSignatures(const QStringList &,QStringList &);
+    bool loadDecipherEngine(const PlayerDetails &);
+    bool loadPlayer(QString,QString &);
     bool parseQueryVideoResponse(QString,VideoDetails &,QString &);
     bool parseVideoPlayerSource(QString,QString &,QString &,QString &,QString &,QString &,QString &);
     bool setDecipherEngine(QString,QString &);
+    void validateMediaEntries(MediaEntryList &,bool);
 public:
     YTScraper();
     ~YTScraper();
@@ -133,6 +182,9 @@ public:
     QString getLastError();
     bool    getVideoDetails(QString,VideoDetails &);
     bool    parseURL(QString,QString &,QString &);
+    bool    refreshMediaURLs(QString,uint,MediaEntryList &);
+    void    setLazyValidation(bool);
+    bool    validateMediaEntry(MediaEntry &);
 };
 
 #endif // YTSCRAPER_H